@@ -1,8 +1,10 @@
 use blake2b_rs::{Blake2b, Blake2bBuilder};
 
 use std::{
+    env,
     fs::{self, File},
     io::{Read, Result, Write},
+    process::Command,
 };
 
 const PATH_PREFIX: &str = "specs/cells/";
@@ -10,6 +12,24 @@ const BUF_SIZE: usize = 8 * 1024;
 const CKB_HASH_PERSONALIZATION: &[u8] = b"ckb-default-hash";
 
 const BINARIES: &[&str] = &["dckb", "dao_lock", "custodian_lock"];
+// flags of the native build, the Makefile CFLAGS without the RISC-V libc
+const NATIVE_CFLAGS: &[&str] = &[
+    "-O2",
+    "-fPIC",
+    "-include",
+    "c/native/ckb_syscalls.h",
+    "-Ic/native",
+    "-Ideps/molecule",
+    "-Ideps/ckb-c-std-lib",
+    "-Ic",
+    "-Ibuild",
+    "-Wall",
+    "-Werror",
+    "-Wno-nonnull-compare",
+    "-Wno-unused-function",
+    "-Wno-unknown-warning-option",
+    "-DTRACE_LEVEL=0",
+];
 
 fn gen_const_file(file_name: &str, const_name: &str, code_hash: &[u8; 32]) -> Result<()> {
     let mut f = fs::OpenOptions::new()
@@ -90,6 +110,44 @@ fn main() {
         f.write_all(&format!("{} -> {}\n", name, actual_hash).into_bytes())
             .expect("write hash");
     }
+    if env::var_os("CARGO_FEATURE_NATIVE_VERIFIER").is_some() {
+        build_native();
+    }
+}
+
+fn run(cmd: &mut Command) {
+    let status = cmd.status().expect("run command");
+    assert!(status.success(), "command failed: {:?}", cmd);
+}
+
+// build the scripts for the host into libdckb_native.a, see src/native.rs
+fn build_native() {
+    let out_dir = env::var("OUT_DIR").expect("OUT_DIR");
+    let cc = env::var("CC").unwrap_or_else(|_| "cc".to_string());
+    let objcopy = env::var("OBJCOPY").unwrap_or_else(|_| "objcopy".to_string());
+    let ar = env::var("AR").unwrap_or_else(|_| "ar".to_string());
+    let mut objects = Vec::new();
+    // the shared helpers, for the property tests of src/tests/native.rs
+    for name in BINARIES.iter().chain(&["helpers"]) {
+        let object = format!("{}/{}_native.o", out_dir, name);
+        run(Command::new(&cc)
+            .args(NATIVE_CFLAGS)
+            .arg("-c")
+            .arg(format!("c/native/{}_native.c", name))
+            .arg("-o")
+            .arg(&object));
+        // the scripts share helper names, keep only the entry globals
+        run(Command::new(&objcopy)
+            .arg("--wildcard")
+            .arg(format!("--keep-global-symbol={}_native_*", name))
+            .arg(&object));
+        objects.push(object);
+    }
+    let lib = format!("{}/libdckb_native.a", out_dir);
+    let _ = fs::remove_file(&lib);
+    run(Command::new(&ar).arg("crs").arg(&lib).args(&objects));
+    println!("cargo:rustc-link-search=native={}", out_dir);
+    println!("cargo:rustc-link-lib=static=dckb_native");
 }
 
 pub fn new_blake2b() -> Blake2b {
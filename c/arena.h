@@ -0,0 +1,95 @@
+/*
+arena.h
+
+A bump allocator over a static region.
+
+Scripts run once and exit, so memory is never freed. Cell lists are allocated
+from the arena and grow with the transaction, instead of reserving the worst
+case on the stack.
+
+A growing list is extended in place when it is the last allocation, otherwise
+it is moved to a new block of twice the capacity.
+
+The native build (native/ckb_syscalls.h) defines ARENA_STORAGE to make the
+region thread local, each thread running a script has its own.
+*/
+
+#ifndef DCKB_ARENA_H
+#define DCKB_ARENA_H
+
+#define ARENA_SIZE (512 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_MIN_LIST_CAP 8
+
+#ifndef ARENA_STORAGE
+#define ARENA_STORAGE static
+#endif
+
+ARENA_STORAGE uint8_t arena_region[ARENA_SIZE]
+    __attribute__((aligned(ARENA_ALIGN)));
+
+typedef struct {
+  uint8_t *ptr;
+  size_t size;
+  size_t used;
+} arena_t;
+
+void init_arena(arena_t *arena) {
+  arena->ptr = arena_region;
+  arena->size = ARENA_SIZE;
+  arena->used = 0;
+}
+
+/* return NULL if the arena is exhausted */
+void *arena_alloc(arena_t *arena, size_t size) {
+  size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (start > arena->size || size > arena->size - start) {
+    return NULL;
+  }
+  arena->used = start + size;
+  return arena->ptr + start;
+}
+
+/* reserve a slot at the end of a list, the list grows in the arena
+ * return NULL if the arena is exhausted */
+void *arena_push(arena_t *arena, void **items, int *cnt, int *cap,
+                 size_t item_size) {
+  if (*cnt == *cap) {
+    int new_cap = *cap == 0 ? ARENA_MIN_LIST_CAP : *cap * 2;
+    uint8_t *end = (uint8_t *)*items + (size_t)*cap * item_size;
+    if (*items != NULL && end == arena->ptr + arena->used) {
+      /* last allocation, extend in place */
+      size_t extra = (size_t)(new_cap - *cap) * item_size;
+      if (extra > arena->size - arena->used) {
+        return NULL;
+      }
+      arena->used += extra;
+    } else {
+      void *new_items = arena_alloc(arena, (size_t)new_cap * item_size);
+      if (new_items == NULL) {
+        return NULL;
+      }
+      if (*cnt > 0) {
+        memcpy(new_items, *items, (size_t)*cnt * item_size);
+      }
+      *items = new_items;
+    }
+    *cap = new_cap;
+  }
+  void *item = (uint8_t *)*items + (size_t)*cnt * item_size;
+  *cnt += 1;
+  return item;
+}
+
+/* typed arena_push for lists declared as `T *name; int name_cnt;
+ * int name_cap;`, evaluates to the new slot or NULL */
+#define ARENA_PUSH(arena, list)                               \
+  ({                                                          \
+    void *items_ = (list);                                    \
+    void *item_ = arena_push((arena), &items_, &(list##_cnt), \
+                             &(list##_cap), sizeof(*(list))); \
+    (list) = (__typeof__(list))items_;                        \
+    (__typeof__(list))item_;                                  \
+  })
+
+#endif
@@ -29,6 +29,9 @@ typedef unsigned __int128 uint128_t;
 #define ERROR_LOAD_ALIGN_TARGET -71
 #define ERROR_INCORRECT_DAO_LOCK -72
 #define ERROR_DAO_LOCK_CHECK -73
+#define ERROR_TOO_MANY_HEADER_DEPS -74
+#define ERROR_INCORRECT_LOCK -75
+#define ERROR_ARENA_EXHAUSTED -76
 
 /* dckb errors */
 #define ERROR_DCKB_INCORRECT_OUTPUT -30
@@ -36,6 +39,8 @@ typedef unsigned __int128 uint128_t;
 #define ERROR_DCKB_INCORRECT_OUTPUT_UNINIT_TOKEN -32
 #define ERROR_DCKB_ALIGN -33
 #define ERROR_DCKB_OUTPUT_ALIGN -34
+#define ERROR_DCKB_HEADER_HINT -35
+#define ERROR_DCKB_DESTROY_AMOUNT -36
 
 /* dao lock errors */
 #define ERROR_DL_CONFLICT_WITHDRAW_PHASE -40
@@ -46,251 +51,942 @@ typedef unsigned __int128 uint128_t;
 #define ERROR_DL_MISMATCH_CUSTODIAN_CELL_TX_HASH -45
 #define ERROR_DL_INVALID_SINCE -46
 #define ERROR_DL_REFUND_CKB_NOT_ENOUGH -47
+#define ERROR_DL_INCOMPLETE_BATCH -48
 
 /* custodian lock errors */
 #define ERROR_CL_MISMATCH_LOCK_HASH -80
 
-#define MAX_SCRIPT_SIZE 32768
 #define MAX_HEADER_SIZE 32768
 #define OUT_POINT_SIZE 36
 
 /* Contract related */
-#define MAX_SWAP_CELLS 256
 #define CKB_LEN 8
 #define SINCE_LEN 8
 #define BLOCK_NUM_LEN 8
 #define UDT_LEN 16
+/* DCKB cell data layouts, distinguished by length:
+ * <amount: uint128> | <block number: uint64>, compatible with sUDT
+ * <version: 1> | <amount: uint64> | <block number: uint64>, compact */
+#define DCKB_DATA_LEN (UDT_LEN + BLOCK_NUM_LEN)
+#define DCKB_COMPACT_DATA_VERSION 1
+#define DCKB_COMPACT_AMOUNT_LEN 8
+#define DCKB_COMPACT_DATA_LEN (1 + DCKB_COMPACT_AMOUNT_LEN + BLOCK_NUM_LEN)
+#define DESTROY_AMOUNT_LEN 8
 #define HASH_SIZE 32
 #define DAO_OCCUPIED_CAPACITY 14600000000          // 146 Bytes
 #define MAX_DEPOSIT_DAO_CAPACITY 1000000000000000  // 10_000_000 CKB
 #define HASH_TYPE_DATA 0
 #define HASH_TYPE_TYPE_ID 1
 
+#include "arena.h"
 #include "ckb_syscalls.h"
 #include "dao_utils.h"
+#include "header_table.h"
+#include "phase.h"
 #include "protocol.h"
 #include "stdio.h"
+#include "trace.h"
 
+/* Cell records of the transaction view. Amounts are uint64_t, a DCKB amount
+ * beyond it is rejected when recorded, as the totals are uint64_t anyway. A
+ * uint128_t would align records to 16 bytes, TokenInfo is 24 bytes instead
+ * of 48. */
 typedef struct {
-  uint128_t amount;
+  uint64_t amount;
 } SwapInfo;
 
 typedef struct {
+  uint64_t amount;
   uint64_t block_number;
-  uint128_t amount;
   uint32_t cell_index;
 } TokenInfo;
 
+/* parse DCKB cell data of either layout */
 int parse_dckb_data(uint128_t *amount, uint64_t *block_number, uint8_t *data,
                     size_t data_len) {
-  if (data_len != UDT_LEN + BLOCK_NUM_LEN) {
-    return ERROR_LOAD_DCKB_DATA;
+  if (data_len == DCKB_DATA_LEN) {
+    *amount = *(uint128_t *)data;
+    *block_number = *(uint64_t *)(data + UDT_LEN);
+    return CKB_SUCCESS;
+  }
+  if (data_len == DCKB_COMPACT_DATA_LEN &&
+      data[0] == DCKB_COMPACT_DATA_VERSION) {
+    uint64_t compact_amount;
+    memcpy(&compact_amount, data + 1, DCKB_COMPACT_AMOUNT_LEN);
+    memcpy(block_number, data + 1 + DCKB_COMPACT_AMOUNT_LEN, BLOCK_NUM_LEN);
+    *amount = compact_amount;
+    return CKB_SUCCESS;
+  }
+  return ERROR_LOAD_DCKB_DATA;
+}
+
+/* serialized Script which args is args_len bytes has a fixed layout:
+ * table header(16) | code_hash(32) | hash_type(1) | args(4 + args_len) */
+#define SCRIPT_CODE_HASH_OFFSET 16
+#define SCRIPT_HASH_TYPE_OFFSET (SCRIPT_CODE_HASH_OFFSET + HASH_SIZE)
+#define SCRIPT_ARGS_FIELD_OFFSET (SCRIPT_HASH_TYPE_OFFSET + 1)
+#define SCRIPT_ARGS_OFFSET (SCRIPT_ARGS_FIELD_OFFSET + MOL_NUM_T_SIZE)
+#define SCRIPT_SIZE_WITH_ARGS(args_len) (SCRIPT_ARGS_OFFSET + (args_len))
+#define MAX_SCRIPT_ARGS_SIZE (HASH_SIZE * 2)
+
+/* check a loaded Script has the fixed layout of args_len bytes args, by
+ * comparing the table header and the args length, then fields are read at
+ * the fixed offsets. Equals MolReader_Script_verify(script, false) for a
+ * script of SCRIPT_SIZE_WITH_ARGS(args_len) bytes. */
+int verify_script_layout(const uint8_t *script, uint64_t len,
+                         size_t args_len) {
+  if (len != SCRIPT_SIZE_WITH_ARGS(args_len)) {
+    return ERROR_ENCODING;
+  }
+  const mol_num_t expected[] = {len, SCRIPT_CODE_HASH_OFFSET,
+                                SCRIPT_HASH_TYPE_OFFSET,
+                                SCRIPT_ARGS_FIELD_OFFSET};
+  for (int i = 0; i < 4; i++) {
+    if (mol_unpack_number(script + MOL_NUM_T_SIZE * i) != expected[i]) {
+      return ERROR_ENCODING;
+    }
+  }
+  if (mol_unpack_number(script + SCRIPT_ARGS_FIELD_OFFSET) != args_len) {
+    return ERROR_ENCODING;
   }
-  *amount = *(uint128_t *)data;
-  *block_number = *(uint64_t *)(data + UDT_LEN);
   return CKB_SUCCESS;
 }
 
-int check_dao_lock(const uint8_t dao_lock_code_hash[HASH_SIZE], uint64_t i,
-                   uint64_t source) {
-  if (dao_lock_code_hash == NULL) {
-    return ERROR_DAO_LOCK_CHECK;
+/* Script context
+ * Loaded once in main, so checks don't reload the script or its hash.
+ */
+typedef struct {
+  /* hash of the running script */
+  uint8_t script_hash[HASH_SIZE];
+  /* script args, only loaded when the script expects args */
+  uint8_t args[MAX_SCRIPT_ARGS_SIZE];
+  size_t args_len;
+  /* code hash and hash type of the running script, loaded with args */
+  uint8_t code_hash[HASH_SIZE];
+  uint8_t hash_type;
+  /* code hashes of the DCKB locks, NULL if the script doesn't use them */
+  const uint8_t *dao_lock_code_hash;
+  const uint8_t *custodian_lock_code_hash;
+} ScriptContext;
+
+/* load the script context, args must be exactly args_len bytes, a script of
+ * other args is ERROR_ENCODING */
+int load_script_context(ScriptContext *context,
+                        const uint8_t *dao_lock_code_hash,
+                        const uint8_t *custodian_lock_code_hash,
+                        size_t args_len) {
+  if (args_len > MAX_SCRIPT_ARGS_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  uint64_t len = HASH_SIZE;
+  int ret = ckb_load_script_hash(context->script_hash, &len, 0);
+  if (ret != CKB_SUCCESS || len != HASH_SIZE) {
+    return ERROR_LOAD_SCRIPT;
+  }
+  context->dao_lock_code_hash = dao_lock_code_hash;
+  context->custodian_lock_code_hash = custodian_lock_code_hash;
+  context->args_len = args_len;
+  if (args_len == 0) {
+    return CKB_SUCCESS;
   }
-  uint8_t script[MAX_SCRIPT_SIZE];
-  uint64_t len = MAX_SCRIPT_SIZE;
+  uint8_t script[SCRIPT_SIZE_WITH_ARGS(MAX_SCRIPT_ARGS_SIZE)];
+  len = SCRIPT_SIZE_WITH_ARGS(args_len);
+  ret = ckb_checked_load_script(script, &len, 0);
+  /* a longer script */
+  if (ret == CKB_LENGTH_NOT_ENOUGH) {
+    return ERROR_ENCODING;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_SCRIPT;
+  }
+  ret = verify_script_layout(script, len, args_len);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  memcpy(context->args, script + SCRIPT_ARGS_OFFSET, args_len);
+  memcpy(context->code_hash, script + SCRIPT_CODE_HASH_OFFSET, HASH_SIZE);
+  context->hash_type = script[SCRIPT_HASH_TYPE_OFFSET];
+  return CKB_SUCCESS;
+}
+
+/* check the lock of a cell is (code_hash, HASH_TYPE_DATA) and copy its args
+ * The locks we check have fixed size args, so only a script of that exact
+ * size is loaded, a lock of any other size is not the expected lock.
+ */
+int load_cell_lock_args(const uint8_t code_hash[HASH_SIZE], uint64_t i,
+                        uint64_t source, uint8_t *args, size_t args_len) {
+  if (args_len > MAX_SCRIPT_ARGS_SIZE) {
+    return ERROR_ARGUMENTS_LEN;
+  }
+  uint8_t script[SCRIPT_SIZE_WITH_ARGS(MAX_SCRIPT_ARGS_SIZE)];
+  uint64_t len = SCRIPT_SIZE_WITH_ARGS(args_len);
   int ret = ckb_checked_load_cell_by_field(script, &len, 0, i, source,
                                            CKB_CELL_FIELD_LOCK);
-  if (ret != CKB_SUCCESS || len > MAX_SCRIPT_SIZE) {
+  if (ret == CKB_LENGTH_NOT_ENOUGH) {
+    return ERROR_INCORRECT_LOCK;
+  }
+  if (ret != CKB_SUCCESS) {
     return ERROR_ENCODING;
   }
-  mol_seg_t script_seg;
-  script_seg.ptr = script;
-  script_seg.size = len;
-  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
+  if (len != SCRIPT_SIZE_WITH_ARGS(args_len)) {
+    return ERROR_INCORRECT_LOCK;
+  }
+  if (verify_script_layout(script, len, args_len) != CKB_SUCCESS) {
     return ERROR_ENCODING;
   }
-  mol_seg_t code_hash_seg = MolReader_Script_get_code_hash(&script_seg);
-  mol_seg_t hash_type_seg = MolReader_Script_get_hash_type(&script_seg);
-  mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
-  mol_seg_t raw_args_seg = MolReader_Bytes_raw_bytes(&args_seg);
-  /* check code hash */
-  ret = memcmp(code_hash_seg.ptr, dao_lock_code_hash, HASH_SIZE);
-  if (ret != 0) {
-    printf("unexpected deposit lock code hash");
-    return ERROR_INCORRECT_DAO_LOCK;
+  if (memcmp(script + SCRIPT_CODE_HASH_OFFSET, code_hash, HASH_SIZE) != 0) {
+    LOG_ERROR("unexpected lock code hash");
+    return ERROR_INCORRECT_LOCK;
+  }
+  if (script[SCRIPT_HASH_TYPE_OFFSET] != HASH_TYPE_DATA) {
+    LOG_ERROR("unexpected lock hash type");
+    return ERROR_INCORRECT_LOCK;
+  }
+  memcpy(args, script + SCRIPT_ARGS_OFFSET, args_len);
+  return CKB_SUCCESS;
+}
+
+/* check the lock is a dao lock which refers to the DCKB type hash */
+int check_dao_lock(const uint8_t dao_lock_code_hash[HASH_SIZE],
+                   const uint8_t dckb_type_hash[HASH_SIZE], uint64_t i,
+                   uint64_t source) {
+  if (dao_lock_code_hash == NULL) {
+    return ERROR_DAO_LOCK_CHECK;
   }
-  /* check hash type */
-  if (*hash_type_seg.ptr != HASH_TYPE_DATA) {
-    printf("unexpected deposit lock hash type");
+  uint8_t args[HASH_SIZE * 2];
+  int ret = load_cell_lock_args(dao_lock_code_hash, i, source, args,
+                                HASH_SIZE * 2);
+  if (ret == ERROR_INCORRECT_LOCK) {
     return ERROR_INCORRECT_DAO_LOCK;
   }
-  /* check args */
-  if (raw_args_seg.size != HASH_SIZE * 2) {
-    printf("unexpected deposit args size %d", raw_args_seg.size);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (memcmp(args, dckb_type_hash, HASH_SIZE) != 0) {
+    LOG_ERROR("unexpected deposit lock args");
     return ERROR_INCORRECT_DAO_LOCK;
   }
-  uint8_t script_hash[HASH_SIZE];
-  len = HASH_SIZE;
-  ret = ckb_load_script_hash(script_hash, &len, 0);
+  return CKB_SUCCESS;
+}
+
+/* lock hashes of cells that check_dao_lock accepted. A lock hash commits to
+ * the whole lock, so a cell of an accepted lock hash is accepted by comparing
+ * the hash. NervosDAO cells of a transaction usually share a few refund locks.
+ * A cache is used with one dao lock code hash and DCKB type hash. */
+#define DAO_LOCK_CACHE_SIZE 4
+
+typedef struct {
+  int len;
+  int next;
+  uint8_t hashes[DAO_LOCK_CACHE_SIZE][HASH_SIZE];
+} dao_lock_cache_t;
+
+/* check_dao_lock of a cell which lock hash is lock_hash, through the cache */
+int check_dao_lock_cached(dao_lock_cache_t *cache,
+                          const uint8_t dao_lock_code_hash[HASH_SIZE],
+                          const uint8_t dckb_type_hash[HASH_SIZE],
+                          const uint8_t lock_hash[HASH_SIZE], uint64_t i,
+                          uint64_t source) {
+  for (int k = 0; k < cache->len; k++) {
+    if (memcmp(cache->hashes[k], lock_hash, HASH_SIZE) == 0) {
+      return CKB_SUCCESS;
+    }
+  }
+  int ret = check_dao_lock(dao_lock_code_hash, dckb_type_hash, i, source);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  memcpy(cache->hashes[cache->next], lock_hash, HASH_SIZE);
+  cache->next = (cache->next + 1) % DAO_LOCK_CACHE_SIZE;
+  if (cache->len < DAO_LOCK_CACHE_SIZE) {
+    cache->len++;
+  }
+  return CKB_SUCCESS;
+}
+
+int load_witness_lock_args(uint64_t index, uint64_t source, uint8_t *lock_arg,
+                           size_t lock_arg_len) {
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, index, source);
+  if (ret == ERROR_ENCODING) {
+    return ERROR_LOAD_WITNESS_ARGS;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = load_witness_args_field(&witness, WITNESS_ARGS_LOCK, lock_arg,
+                                lock_arg_len);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_WITNESS_ARGS;
+  }
+  return CKB_SUCCESS;
+}
+
+/* destroyed DCKB committed in witness output_type of the first DCKB output,
+ * inputs DCKB (aligned) - outputs DCKB, excluding new DCKB.
+ * DCKB verifies the amount when it is given, so other scripts of the
+ * transaction can use it instead of aligning inputs again.
+ * has_amount is 0 if the witness is missing, is not a WitnessArgs or has no
+ * output_type */
+int load_committed_destroy_amount(uint64_t index, uint64_t source,
+                                  int *has_amount, uint64_t *amount) {
+  *has_amount = 0;
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, index, source);
+  if (ret == CKB_INDEX_OUT_OF_BOUND || ret == ERROR_ENCODING) {
+    return CKB_SUCCESS;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
+  }
+  if (!witness.field_has[WITNESS_ARGS_OUTPUT_TYPE]) {
+    return CKB_SUCCESS;
+  }
+  ret = load_witness_args_field(&witness, WITNESS_ARGS_OUTPUT_TYPE,
+                                (uint8_t *)amount, DESTROY_AMOUNT_LEN);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_WITNESS_ARGS;
+  }
+  *has_amount = 1;
+  return CKB_SUCCESS;
+}
+
+/* header deps indexes of input DCKB deposit headers, given by the witness */
+typedef struct {
+  /* NULL if not given */
+  const uint8_t *indexes;
+  uint32_t len;
+} HeaderHints;
+
+/* align target from witness input_type,
+ * <target block number> | [<target header index> | <deposit header index>...]
+ * the header indexes are optional, a deposit header index is given for each
+ * input DCKB in order */
+typedef struct {
+  uint64_t block_number;
+  /* header deps index of the target, -1 if not given */
+  int header_index;
+  HeaderHints hints;
+} AlignTarget;
+
+/* load the align target from the witness, no header is loaded */
+int load_align_target(arena_t *arena, uint64_t i, uint64_t source,
+                      AlignTarget *target) {
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, i, source);
+  if (ret == ERROR_ENCODING) {
+    return ERROR_LOAD_WITNESS_ARGS;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_DAO_HEADER_DATA;
+  }
+
+  // load align target block number from witness
+  uint32_t type_len = witness.field_size[WITNESS_ARGS_INPUT_TYPE];
+  if (type_len < BLOCK_NUM_LEN) {
+    LOG_ERROR("input_type is not a block number");
+    return ERROR_LOAD_DAO_HEADER_DATA;
+  }
+  uint8_t *type_bytes = arena_alloc(arena, type_len);
+  if (type_bytes == NULL) {
+    return ERROR_ARENA_EXHAUSTED;
+  }
+  ret = load_witness_args_field(&witness, WITNESS_ARGS_INPUT_TYPE, type_bytes,
+                                type_len);
+  if (ret != CKB_SUCCESS) {
+    LOG_ERROR("input_type is not a block number");
+    return ERROR_LOAD_DAO_HEADER_DATA;
+  }
+  target->block_number = *(uint64_t *)type_bytes;
+  if (type_len == BLOCK_NUM_LEN) {
+    target->header_index = -1;
+    target->hints.indexes = NULL;
+    target->hints.len = 0;
+  } else {
+    target->header_index = type_bytes[BLOCK_NUM_LEN];
+    target->hints.indexes = type_bytes + BLOCK_NUM_LEN + 1;
+    target->hints.len = type_len - BLOCK_NUM_LEN - 1;
+  }
+  return CKB_SUCCESS;
+}
+
+/* load the header of an align target */
+int load_align_target_header(header_table_t *header_table,
+                             const AlignTarget *target,
+                             dao_header_data_t *dao_header_data) {
+  int ret;
+  if (target->header_index < 0) {
+    ret = header_table_search(header_table, target->block_number,
+                              dao_header_data);
+  } else {
+    ret = header_table_get(header_table, target->header_index,
+                           dao_header_data);
+    if (ret == CKB_SUCCESS &&
+        dao_header_data->block_number != target->block_number) {
+      LOG_DEBUG("align target hint %d is header %ld", target->header_index,
+                dao_header_data->block_number);
+      return ERROR_DCKB_HEADER_HINT;
+    }
+  }
+  LOG_DEBUG("load dao header number %ld ret %d", target->block_number, ret);
+  if (ret == ERROR_TOO_MANY_HEADER_DEPS) {
+    return ret;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_HEADER;
+  }
+  return CKB_SUCCESS;
+}
+
+/* load the align target and its header, hints is NULL if the caller does not
+ * use them */
+int load_align_target_dao_header_data(header_table_t *header_table,
+                                      arena_t *arena, uint64_t i,
+                                      uint64_t source,
+                                      dao_header_data_t *dao_header_data,
+                                      HeaderHints *hints) {
+  AlignTarget target;
+  int ret = load_align_target(arena, i, source, &target);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = load_align_target_header(header_table, &target, dao_header_data);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (hints != NULL) {
+    *hints = target.hints;
+  }
+  return CKB_SUCCESS;
+}
+
+/* find deposit header dep index of the k-th input DCKB, by the hint if given
+ * otherwise by searching */
+int find_deposit_header(header_table_t *header_table, const HeaderHints *hints,
+                        size_t k, uint64_t deposited_block_number,
+                        size_t *deposit_index) {
+  if (hints->indexes == NULL) {
+    int ret = header_table_lookup(header_table, deposited_block_number,
+                                  deposit_index);
+    if (ret == ERROR_TOO_MANY_HEADER_DEPS) {
+      return ret;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ERROR_LOAD_DAO_HEADER_DATA;
+    }
+    return CKB_SUCCESS;
+  }
+  if (k >= hints->len) {
+    return ERROR_DCKB_HEADER_HINT;
+  }
+  dao_header_data_t deposit_data;
+  int ret = header_table_get(header_table, hints->indexes[k], &deposit_data);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_DAO_HEADER_DATA;
+  }
+  if (deposit_data.block_number != deposited_block_number) {
+    LOG_ERROR("header hint %d is block %ld, expected %ld", hints->indexes[k],
+              deposit_data.block_number, deposited_block_number);
+    return ERROR_DCKB_HEADER_HINT;
+  }
+  *deposit_index = hints->indexes[k];
+  return CKB_SUCCESS;
+}
+
+/* align amount deposited at the header dep to the target */
+int align_deposited_amount(header_table_t *header_table, size_t deposit_index,
+                           dao_header_data_t align_target_data,
+                           uint64_t original_capacity,
+                           uint64_t *calculated_capacity) {
+  uint64_t deposited_block_number =
+      header_table->headers[deposit_index].block_number;
+  if (align_target_data.block_number == deposited_block_number) {
+    *calculated_capacity = original_capacity;
+    return CKB_SUCCESS;
+  }
+
+  if (align_target_data.block_number < deposited_block_number) {
+    LOG_ERROR("align error target number %ld deposit number %ld",
+              align_target_data.block_number, deposited_block_number);
+    return ERROR_DCKB_ALIGN;
+  }
+
+  const udiv128_divisor_t *deposit_ar_divisor;
+  int ret =
+      header_table_divisor(header_table, deposit_index, &deposit_ar_divisor);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  return calculate_dao_input_capacity_by_divisor(
+      0, deposit_ar_divisor, align_target_data.accumulate_rate,
+      original_capacity, calculated_capacity);
+}
+
+int align_dckb_cell(header_table_t *header_table, size_t i, size_t source,
+                    dao_header_data_t align_target_data,
+                    uint64_t deposited_block_number, uint64_t original_capacity,
+                    uint64_t *calculated_capacity) {
+  /* new dckb, aligned from its own header */
+  if (deposited_block_number == 0) {
+    dao_header_data_t deposit_data;
+    int ret = load_dao_header_data(i, source, &deposit_data);
+    LOG_TRACE("new dckb deposit block ret %d", ret);
+    if (ret != CKB_SUCCESS) {
+      return ERROR_LOAD_DAO_HEADER_DATA;
+    }
+    LOG_TRACE("new dckb deposit block %ld", deposit_data.block_number);
+    if (align_target_data.block_number == deposit_data.block_number) {
+      *calculated_capacity = original_capacity;
+      return CKB_SUCCESS;
+    }
+    if (align_target_data.block_number < deposit_data.block_number) {
+      LOG_ERROR("align error target number %ld deposit number %ld",
+                align_target_data.block_number, deposit_data.block_number);
+      return ERROR_DCKB_ALIGN;
+    }
+    return calculate_dao_input_capacity(
+        0, deposit_data, align_target_data, deposit_data.block_number,
+        original_capacity, calculated_capacity);
+  }
+
+  size_t deposit_index;
+  int ret =
+      header_table_lookup(header_table, deposited_block_number, &deposit_index);
+  LOG_TRACE("load dao header data by cell i %ld source %ld ret %d", i, source,
+            ret);
+  if (ret == ERROR_TOO_MANY_HEADER_DEPS) {
+    return ret;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_DAO_HEADER_DATA;
+  }
+  return align_deposited_amount(header_table, deposit_index, align_target_data,
+                                original_capacity, calculated_capacity);
+}
+
+/* Cell kinds, classified by type hash and data */
+#define CELL_KIND_OTHER 0
+/* NervosDAO deposit cell, data is 8 bytes 0 */
+#define CELL_KIND_DAO_DEPOSIT 1
+/* NervosDAO withdrawing cell, data is the 8 bytes deposit block number */
+#define CELL_KIND_DAO_WITHDRAW 2
+/* DCKB cell */
+#define CELL_KIND_DCKB 3
+
+/* Transaction view
+ * Inputs and outputs are each scanned once, cells are classified and only the
+ * parts scripts use are recorded, so scripts do not rescan the transaction.
+ */
+typedef struct {
+  /* DCKB type hash, required */
+  const uint8_t *dckb_type_hash;
+  /* if set, record output deposited NervosDAO cells that locked by this dao
+   * lock and refer to the DCKB type hash */
+  const uint8_t *dao_lock_code_hash;
+  /* if set, record input NervosDAO cells which lock hash is this */
+  const uint8_t *group_lock_hash;
+  /* group_lock_hash only, if set, record input NervosDAO cells of other
+   * groups that locked by this dao lock and refer to the DCKB type hash */
+  const uint8_t *batch_dao_lock_code_hash;
+  /* if set, sum the capacity of outputs which lock hash is this */
+  const uint8_t *refund_lock_hash;
+  /* accumulator mode, DCKB cells and deposited NervosDAO cells are summed
+   * into the view totals during the scan instead of recorded in lists.
+   * Input DCKB are aligned to align_target, output DCKB must be aligned to
+   * align_target_number, each is NULL if not loaded. fetch_outputs needs no
+   * header, so outputs can be checked before the target header is loaded. */
+  int accumulate;
+  /* accumulator mode only, input DCKB of the same deposit height are summed
+   * and aligned once, so rounding is per height instead of per cell. This
+   * changes the issued amounts, see DCKB_ALIGN_SUM_BY_HEIGHT */
+  int sum_by_height;
+  header_table_t *header_table;
+  const dao_header_data_t *align_target;
+  const uint64_t *align_target_number;
+  /* accumulator mode only, deposit header indexes from the witness */
+  HeaderHints deposit_header_hints;
+} TxViewConfig;
+
+/* cell lists are allocated from the arena and grow with the transaction */
+#define TX_VIEW_LIST(T, name) \
+  T *name;                    \
+  int name##_cnt;             \
+  int name##_cap
+
+typedef struct {
+  arena_t *arena;
+  /* inputs */
+  TX_VIEW_LIST(TokenInfo, input_dckb);
+  /* NervosDAO inputs locked by group_lock_hash, amount is the capacity and
+   * block_number is the cell data, 0 means a deposit cell */
+  TX_VIEW_LIST(TokenInfo, group_dao);
+  /* NervosDAO inputs of other dao lock groups, same as group_dao, in either
+   * withdraw phase */
+  TX_VIEW_LIST(TokenInfo, batch_dao);
+  /* outputs */
+  TX_VIEW_LIST(SwapInfo, deposited_dao);
+  TX_VIEW_LIST(SwapInfo, output_new_dckb);
+  TX_VIEW_LIST(TokenInfo, output_dckb);
+  /* index of the first DCKB output including new DCKB, -1 if none */
+  int64_t first_output_dckb;
+  uint64_t refund_capacity;
+  /* totals of accumulator mode, deposited NervosDAO excludes the occupied
+   * capacity */
+  uint64_t total_input_dckb;
+  uint64_t total_output_dckb;
+  uint64_t total_output_new_dckb;
+  uint64_t total_deposited_dao;
+  /* accumulator mode, count of input DCKB */
+  int accumulated_input_dckb_cnt;
+  /* sum_by_height mode, input DCKB amounts by deposit header dep index */
+  uint64_t *height_amounts;
+  /* accepted dao locks of batch NervosDAO inputs and deposited outputs */
+  dao_lock_cache_t batch_dao_locks;
+  dao_lock_cache_t deposit_dao_locks;
+} TxView;
+
+void init_tx_view(TxView *view, arena_t *arena) {
+  memset(view, 0, sizeof(TxView));
+  view->arena = arena;
+}
+
+/* add amount to total, amount must fit in uint64_t */
+int add_total(uint64_t *total, uint128_t amount) {
+  if ((uint64_t)amount != amount) {
+    return ERROR_OVERFLOW;
+  }
+  if (__builtin_uaddl_overflow(*total, (uint64_t)amount, total)) {
+    return ERROR_OVERFLOW;
+  }
+  return CKB_SUCCESS;
+}
+
+/* order of cells by deposit height, as indexes into cells. Cells of the same
+ * height keep their order. Insertion sort, the inputs of a height are usually
+ * adjacent already (see src/selector.rs). NULL if the arena is exhausted */
+uint16_t *sort_by_height(arena_t *arena, const TokenInfo *cells, int cnt) {
+  uint16_t *order = arena_alloc(arena, (size_t)cnt * sizeof(uint16_t));
+  if (order == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < cnt; i++) {
+    uint64_t block_number = cells[i].block_number;
+    int j = i;
+    while (j > 0 && cells[order[j - 1]].block_number > block_number) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+  return order;
+}
+
+/* type hashes the fetch loops classify, as 64-bit words. The first word
+ * tells an unrelated type apart, a match is 4 word compares instead of a
+ * byte by byte memcmp. */
+#define HASH_WORDS (HASH_SIZE / sizeof(uint64_t))
+
+typedef struct {
+  uint64_t dao[HASH_WORDS];
+  uint64_t dckb[HASH_WORDS];
+} cell_kind_table_t;
+
+void init_cell_kind_table(cell_kind_table_t *table,
+                          const uint8_t dckb_type_hash[HASH_SIZE]) {
+  memcpy(table->dao, NERVOS_DAO_TYPE_HASH, HASH_SIZE);
+  memcpy(table->dckb, dckb_type_hash, HASH_SIZE);
+}
+
+int hash_words_eq(const uint64_t a[HASH_WORDS], const uint64_t b[HASH_WORDS]) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+}
+
+/* classify a cell by type hash, cell data is only loaded for NervosDAO and
+ * DCKB cells */
+int load_cell_kind(const cell_kind_table_t *table, size_t i, size_t source,
+                   uint8_t data[DCKB_DATA_LEN], uint64_t *data_len,
+                   int *kind) {
+  uint64_t type_hash[HASH_WORDS];
+  uint64_t len = HASH_SIZE;
+  int ret = ckb_checked_load_cell_by_field(type_hash, &len, 0, i, source,
+                                           CKB_CELL_FIELD_TYPE_HASH);
+  if (ret == CKB_INDEX_OUT_OF_BOUND) {
+    return ret;
+  }
+  *kind = CELL_KIND_OTHER;
+  if (ret == CKB_ITEM_MISSING) {
+    return CKB_SUCCESS;
+  }
   if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-    return ERROR_ENCODING;
+    return ERROR_LOAD_TYPE_HASH;
   }
-  ret = memcmp(script_hash, raw_args_seg.ptr, HASH_SIZE);
-  if (ret != 0) {
-    printf("unexpected deposit lock args");
-    return ERROR_INCORRECT_DAO_LOCK;
+  int is_dao = hash_words_eq(type_hash, table->dao);
+  if (!is_dao && !hash_words_eq(type_hash, table->dckb)) {
+    return CKB_SUCCESS;
+  }
+  *data_len = DCKB_DATA_LEN;
+  ret = ckb_load_cell_data(data, data_len, 0, i, source);
+  if (ret != CKB_SUCCESS || *data_len > DCKB_DATA_LEN) {
+    return ERROR_LOAD_DCKB_DATA;
+  }
+  if (!is_dao) {
+    *kind = CELL_KIND_DCKB;
+  } else if (is_dao_deposit_cell(data, *data_len)) {
+    *kind = CELL_KIND_DAO_DEPOSIT;
+  } else if (is_dao_withdraw1_cell(data, *data_len)) {
+    *kind = CELL_KIND_DAO_WITHDRAW;
   }
   return CKB_SUCCESS;
 }
 
 /* fetch inputs coins */
-int fetch_inputs(const uint8_t dckb_type_hash[HASH_SIZE],
-                 const uint8_t dao_lock_code_hash[HASH_SIZE],
-                 int *withdraw1_dao_cnt,
-                 TokenInfo withdraw1_dao_infos[MAX_SWAP_CELLS],
-                 int *withdraw2_dao_cnt,
-                 TokenInfo withdraw2_dao_infos[MAX_SWAP_CELLS],
-                 int *input_dckb_cnt,
-                 TokenInfo input_dckb_infos[MAX_SWAP_CELLS]) {
-  if (withdraw1_dao_cnt) *withdraw1_dao_cnt = 0;
-  if (withdraw2_dao_cnt) *withdraw2_dao_cnt = 0;
-  if (input_dckb_cnt) *input_dckb_cnt = 0;
-  int i = 0;
+/* sum_by_height mode, add an input DCKB amount to its deposit height */
+int sum_input_by_height(TxView *view, size_t deposit_index, uint64_t amount) {
+  if (view->height_amounts == NULL) {
+    view->height_amounts =
+        arena_alloc(view->arena, MAX_HEADER_DEPS * sizeof(uint64_t));
+    if (view->height_amounts == NULL) {
+      return ERROR_ARENA_EXHAUSTED;
+    }
+    memset(view->height_amounts, 0, MAX_HEADER_DEPS * sizeof(uint64_t));
+  }
+  return add_total(&view->height_amounts[deposit_index], amount);
+}
+
+/* sum_by_height mode, align summed amounts once per deposit height */
+int align_summed_inputs(const TxViewConfig *config, TxView *view) {
+  for (size_t i = 0; i < config->header_table->len; i++) {
+    if (view->height_amounts[i] == 0) {
+      continue;
+    }
+    uint64_t aligned_amount;
+    int ret = align_deposited_amount(config->header_table, i,
+                                     *config->align_target,
+                                     view->height_amounts[i], &aligned_amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    LOG_TRACE("summed input amount %ld, block_number %ld, aligned amount %ld",
+              view->height_amounts[i],
+              config->header_table->headers[i].block_number, aligned_amount);
+    ret = add_total(&view->total_input_dckb, aligned_amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+  }
+  return CKB_SUCCESS;
+}
+
+int fetch_inputs(const TxViewConfig *config, TxView *view) {
+  view->input_dckb_cnt = 0;
+  view->group_dao_cnt = 0;
+  view->batch_dao_cnt = 0;
+  cell_kind_table_t kinds;
+  init_cell_kind_table(&kinds, config->dckb_type_hash);
   int ret;
   uint64_t len;
+  size_t i = 0;
   while (1) {
-    unsigned char input_type_hash[HASH_SIZE];
-    len = HASH_SIZE;
-    ret = ckb_checked_load_cell_by_field(input_type_hash, &len, 0, i,
-                                         CKB_SOURCE_INPUT,
-                                         CKB_CELL_FIELD_TYPE_HASH);
+    uint8_t buf[DCKB_DATA_LEN];
+    uint64_t data_len;
+    int kind;
+    ret = load_cell_kind(&kinds, i, CKB_SOURCE_INPUT, buf, &data_len, &kind);
     if (ret == CKB_INDEX_OUT_OF_BOUND) {
       break;
     }
-    if (ret == CKB_ITEM_MISSING) {
-      goto next;
-    }
-    printf("load cell type ret %d len %ld", ret, len);
-    if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-      return ERROR_LOAD_TYPE_HASH;
-    }
-    uint8_t buf[UDT_LEN + BLOCK_NUM_LEN];
-    len = UDT_LEN + BLOCK_NUM_LEN;
-    ret = ckb_load_cell_data(buf, &len, 0, i, CKB_SOURCE_INPUT);
-    if (ret == CKB_ITEM_MISSING) {
-      goto next;
-    }
-    printf("load input cell data ret %d len %ld", ret, len);
-    if (ret != CKB_SUCCESS || len > UDT_LEN + BLOCK_NUM_LEN) {
-      return ERROR_LOAD_TYPE_HASH;
+    LOG_TRACE("load input cell kind ret %d kind %d", ret, kind);
+    if (ret != CKB_SUCCESS) {
+      return ret;
     }
-    int is_dao = is_dao_type(input_type_hash);
-    if (is_dao) {
-      printf("check a new withdraw cell");
-      /* only count deposit lock dao cells */
-      ret = check_dao_lock(dao_lock_code_hash, i, CKB_SOURCE_INPUT);
-      printf("check deposit lock ret %d", ret);
-      if (ret != CKB_SUCCESS) {
+    if (kind == CELL_KIND_DAO_DEPOSIT || kind == CELL_KIND_DAO_WITHDRAW) {
+      if (!config->group_lock_hash) {
+        goto next;
+      }
+      uint8_t lock_hash[HASH_SIZE];
+      len = HASH_SIZE;
+      ret = ckb_checked_load_cell_by_field(lock_hash, &len, 0, i,
+                                           CKB_SOURCE_INPUT,
+                                           CKB_CELL_FIELD_LOCK_HASH);
+      if (ret != CKB_SUCCESS || len != HASH_SIZE) {
+        return ERROR_ENCODING;
+      }
+      int in_group = memcmp(lock_hash, config->group_lock_hash, HASH_SIZE) == 0;
+      if (!in_group &&
+          (!config->batch_dao_lock_code_hash ||
+           check_dao_lock_cached(&view->batch_dao_locks,
+                                 config->batch_dao_lock_code_hash,
+                                 config->dckb_type_hash, lock_hash, i,
+                                 CKB_SOURCE_INPUT) != CKB_SUCCESS)) {
         goto next;
       }
-      /* withdraw NervosDAO */
-      uint64_t deposited_block_number = *(uint64_t *)buf;
-      len = CKB_LEN;
       uint64_t original_capacity;
+      len = CKB_LEN;
       ret = ckb_checked_load_cell_by_field((uint8_t *)&original_capacity, &len,
                                            0, i, CKB_SOURCE_INPUT,
                                            CKB_CELL_FIELD_CAPACITY);
       if (ret != CKB_SUCCESS || len != CKB_LEN) {
         return ERROR_LOAD_CAPACITY;
       }
-      /* record withdraw amount */
-      if (is_dao_withdraw1_cell(buf, len)) {
-        if (!withdraw1_dao_cnt || !withdraw1_dao_infos) {
-          goto next;
-        }
-        int j = *withdraw1_dao_cnt;
-        *withdraw1_dao_cnt += 1;
-        withdraw1_dao_infos[j].amount = original_capacity;
-        withdraw1_dao_infos[j].block_number = deposited_block_number;
-        withdraw1_dao_infos[j].cell_index = i;
-      } else {
-        if (!withdraw2_dao_cnt || !withdraw2_dao_infos) {
-          goto next;
-        }
-        int j = *withdraw2_dao_cnt;
-        *withdraw2_dao_cnt += 1;
-        withdraw2_dao_infos[j].amount = original_capacity;
-        withdraw2_dao_infos[j].block_number = deposited_block_number;
-        withdraw2_dao_infos[j].cell_index = i;
+      /* record group or batch NervosDAO cell */
+      TokenInfo *item = in_group ? ARENA_PUSH(view->arena, view->group_dao)
+                                 : ARENA_PUSH(view->arena, view->batch_dao);
+      if (item == NULL) {
+        return ERROR_ARENA_EXHAUSTED;
       }
-    } else if (memcmp(input_type_hash, dckb_type_hash, HASH_SIZE) == 0) {
-      /* DCKB */
+      item->amount = original_capacity;
+      item->block_number = *(uint64_t *)buf;
+      item->cell_index = i;
+    } else if (kind == CELL_KIND_DCKB) {
       uint128_t amount;
       uint64_t block_number;
-      ret = parse_dckb_data(&amount, &block_number, buf, len);
+      ret = parse_dckb_data(&amount, &block_number, buf, data_len);
       if (ret != CKB_SUCCESS) {
         return ret;
       }
+      if (config->accumulate) {
+        if (config->align_target == NULL) {
+          return ERROR_LOAD_ALIGN_TARGET;
+        }
+        if ((uint64_t)amount != amount) {
+          return ERROR_OVERFLOW;
+        }
+        size_t k = view->accumulated_input_dckb_cnt++;
+        uint64_t aligned_amount;
+        if (block_number == 0) {
+          ret = align_dckb_cell(config->header_table, i, CKB_SOURCE_INPUT,
+                                *config->align_target, block_number, amount,
+                                &aligned_amount);
+        } else {
+          size_t deposit_index;
+          ret = find_deposit_header(config->header_table,
+                                    &config->deposit_header_hints, k,
+                                    block_number, &deposit_index);
+          if (ret != CKB_SUCCESS) {
+            return ret;
+          }
+          if (config->sum_by_height) {
+            ret = sum_input_by_height(view, deposit_index, amount);
+            if (ret != CKB_SUCCESS) {
+              return ret;
+            }
+            goto next;
+          }
+          ret = align_deposited_amount(config->header_table, deposit_index,
+                                       *config->align_target, amount,
+                                       &aligned_amount);
+        }
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+        LOG_TRACE("input amount %ld, block_number %ld, aligned amount %ld",
+                  (uint64_t)amount, block_number, aligned_amount);
+        ret = add_total(&view->total_input_dckb, aligned_amount);
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+        goto next;
+      }
       /* record input amount */
-      int j = *input_dckb_cnt;
-      *input_dckb_cnt += 1;
-      input_dckb_infos[j].amount = amount;
-      input_dckb_infos[j].block_number = block_number;
-      input_dckb_infos[j].cell_index = i;
+      if ((uint64_t)amount != amount) {
+        return ERROR_OVERFLOW;
+      }
+      TokenInfo *item = ARENA_PUSH(view->arena, view->input_dckb);
+      if (item == NULL) {
+        return ERROR_ARENA_EXHAUSTED;
+      }
+      item->amount = amount;
+      item->block_number = block_number;
+      item->cell_index = i;
     }
   next:
     i++;
   }
+  /* a hint for each input DCKB */
+  if (config->deposit_header_hints.indexes != NULL &&
+      config->deposit_header_hints.len !=
+          (uint32_t)view->accumulated_input_dckb_cnt) {
+    return ERROR_DCKB_HEADER_HINT;
+  }
+  if (view->height_amounts != NULL) {
+    return align_summed_inputs(config, view);
+  }
   return CKB_SUCCESS;
 }
 
 /* fetch outputs coins */
-int fetch_outputs(const uint8_t dckb_type_hash[HASH_SIZE],
-                  const uint8_t dao_lock_code_hash[HASH_SIZE],
-                  int *deposited_dao_cnt,
-                  SwapInfo deposited_dao[MAX_SWAP_CELLS],
-                  int *new_dckb_cell_cnt,
-                  SwapInfo new_dckb_cell[MAX_SWAP_CELLS], int *dckb_cell_cnt,
-                  TokenInfo dckb_cell[MAX_SWAP_CELLS]) {
-  if (deposited_dao_cnt) *deposited_dao_cnt = 0;
-  if (new_dckb_cell_cnt) *new_dckb_cell_cnt = 0;
-  if (dckb_cell_cnt) *dckb_cell_cnt = 0;
+int fetch_outputs(const TxViewConfig *config, TxView *view) {
+  view->deposited_dao_cnt = 0;
+  view->output_new_dckb_cnt = 0;
+  view->output_dckb_cnt = 0;
+  view->first_output_dckb = -1;
+  view->refund_capacity = 0;
+  cell_kind_table_t kinds;
+  init_cell_kind_table(&kinds, config->dckb_type_hash);
   int ret;
+  uint64_t len;
   /* iterate all outputs */
-  int i = 0;
+  size_t i = 0;
   while (1) {
-    unsigned char output_type_hash[HASH_SIZE];
-    uint64_t len = HASH_SIZE;
-    ret = ckb_checked_load_cell_by_field(output_type_hash, &len, 0, i,
-                                         CKB_SOURCE_OUTPUT,
-                                         CKB_CELL_FIELD_TYPE_HASH);
-    printf("load output type ret %d", ret);
+    uint8_t lock_hash[HASH_SIZE];
+    int has_lock_hash = 0;
+    if (config->refund_lock_hash) {
+      len = HASH_SIZE;
+      ret = ckb_checked_load_cell_by_field(lock_hash, &len, 0, i,
+                                           CKB_SOURCE_OUTPUT,
+                                           CKB_CELL_FIELD_LOCK_HASH);
+      if (ret == CKB_INDEX_OUT_OF_BOUND) {
+        break;
+      }
+      if (ret != CKB_SUCCESS || len != HASH_SIZE) {
+        return ERROR_ENCODING;
+      }
+      has_lock_hash = 1;
+      if (memcmp(lock_hash, config->refund_lock_hash, HASH_SIZE) == 0) {
+        uint64_t capacity;
+        len = CKB_LEN;
+        ret = ckb_checked_load_cell_by_field((uint8_t *)&capacity, &len, 0, i,
+                                             CKB_SOURCE_OUTPUT,
+                                             CKB_CELL_FIELD_CAPACITY);
+        if (ret != CKB_SUCCESS || len != CKB_LEN) {
+          return ERROR_ENCODING;
+        }
+        if (__builtin_uaddl_overflow(view->refund_capacity, capacity,
+                                     &view->refund_capacity)) {
+          return ERROR_OVERFLOW;
+        }
+      }
+    }
+    uint8_t buf[DCKB_DATA_LEN];
+    uint64_t data_len;
+    int kind;
+    ret = load_cell_kind(&kinds, i, CKB_SOURCE_OUTPUT, buf, &data_len, &kind);
     if (ret == CKB_INDEX_OUT_OF_BOUND) {
       break;
     }
-    if (ret == CKB_ITEM_MISSING) {
-      goto next;
-    }
-    if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-      return ERROR_LOAD_TYPE_HASH;
-    }
-    len = BLOCK_NUM_LEN + UDT_LEN;
-    uint8_t buf[BLOCK_NUM_LEN + UDT_LEN];
-    ret = ckb_load_cell_data(buf, &len, 0, i, CKB_SOURCE_OUTPUT);
-    if (ret == CKB_ITEM_MISSING) {
-      goto next;
-    }
-    if (ret != CKB_SUCCESS || len > (UDT_LEN + BLOCK_NUM_LEN)) {
-      return ERROR_LOAD_DCKB_DATA;
+    LOG_TRACE("load output cell kind ret %d kind %d", ret, kind);
+    if (ret != CKB_SUCCESS) {
+      return ret;
     }
-    int is_dao = is_dao_type(output_type_hash) && is_dao_deposit_cell(buf, len);
-    printf("check output is dao %d", is_dao);
-    if (is_dao) {
-      printf("check a new deposit cell");
-      if (!deposited_dao_cnt || !deposited_dao) goto next;
+    if (kind == CELL_KIND_DAO_DEPOSIT) {
+      if (!config->dao_lock_code_hash) {
+        goto next;
+      }
+      LOG_TRACE("check a new deposit cell");
+      if (!has_lock_hash) {
+        len = HASH_SIZE;
+        ret = ckb_checked_load_cell_by_field(lock_hash, &len, 0, i,
+                                             CKB_SOURCE_OUTPUT,
+                                             CKB_CELL_FIELD_LOCK_HASH);
+        if (ret != CKB_SUCCESS || len != HASH_SIZE) {
+          return ERROR_ENCODING;
+        }
+      }
       /* only count deposit lock dao cells */
-      ret = check_dao_lock(dao_lock_code_hash, i, CKB_SOURCE_OUTPUT);
-      printf("check deposit lock ret %d", ret);
+      ret = check_dao_lock_cached(&view->deposit_dao_locks,
+                                  config->dao_lock_code_hash,
+                                  config->dckb_type_hash, lock_hash, i,
+                                  CKB_SOURCE_OUTPUT);
+      LOG_TRACE("check deposit lock ret %d", ret);
       if (ret != CKB_SUCCESS) {
         goto next;
       }
@@ -306,41 +1002,71 @@ int fetch_outputs(const uint8_t dckb_type_hash[HASH_SIZE],
       if (amount > MAX_DEPOSIT_DAO_CAPACITY) {
         goto next;
       }
+      if (config->accumulate) {
+        /* remove DAO cell occupied capacity */
+        if (__builtin_usubl_overflow(amount, DAO_OCCUPIED_CAPACITY, &amount)) {
+          return ERROR_OVERFLOW;
+        }
+        ret = add_total(&view->total_deposited_dao, amount);
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+        goto next;
+      }
       /* record deposited dao amount */
-      if (*deposited_dao_cnt >= MAX_SWAP_CELLS) {
-        return ERROR_DCKB_TOO_MANY_SWAPS;
+      SwapInfo *item = ARENA_PUSH(view->arena, view->deposited_dao);
+      if (item == NULL) {
+        return ERROR_ARENA_EXHAUSTED;
+      }
+      item->amount = amount;
+    } else if (kind == CELL_KIND_DCKB) {
+      if (view->first_output_dckb < 0) {
+        view->first_output_dckb = i;
       }
-      int new_i = *deposited_dao_cnt;
-      *deposited_dao_cnt += 1;
-      deposited_dao[new_i].amount = amount;
-    } else if (memcmp(output_type_hash, dckb_type_hash, HASH_SIZE) == 0) {
       /* check dckb cell */
       uint128_t amount;
       uint64_t block_number;
-      ret = parse_dckb_data(&amount, &block_number, buf, len);
+      ret = parse_dckb_data(&amount, &block_number, buf, data_len);
       if (ret != CKB_SUCCESS) {
         return ret;
       }
-      printf("fetch output -> dckb block_number %ld", block_number);
-      if (block_number == 0) {
-        if (!new_dckb_cell_cnt || !new_dckb_cell) goto next;
+      LOG_TRACE("fetch output -> dckb block_number %ld", block_number);
+      if (config->accumulate && block_number == 0) {
+        ret = add_total(&view->total_output_new_dckb, amount);
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+      } else if (config->accumulate) {
+        if (config->align_target_number == NULL) {
+          return ERROR_LOAD_ALIGN_TARGET;
+        }
+        if (block_number != *config->align_target_number) {
+          LOG_ERROR("output align to %ld, expected %ld", block_number,
+                    *config->align_target_number);
+          return ERROR_DCKB_OUTPUT_ALIGN;
+        }
+        ret = add_total(&view->total_output_dckb, amount);
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+      } else if ((uint64_t)amount != amount) {
+        return ERROR_OVERFLOW;
+      } else if (block_number == 0) {
         /* new dckb */
-        if (*new_dckb_cell_cnt >= MAX_SWAP_CELLS) {
-          return ERROR_DCKB_TOO_MANY_SWAPS;
+        SwapInfo *item = ARENA_PUSH(view->arena, view->output_new_dckb);
+        if (item == NULL) {
+          return ERROR_ARENA_EXHAUSTED;
         }
-        int new_i = *new_dckb_cell_cnt;
-        *new_dckb_cell_cnt += 1;
-        new_dckb_cell[new_i].amount = amount;
+        item->amount = amount;
       } else {
-        if (!dckb_cell_cnt || !dckb_cell) goto next;
         /* dckb */
-        if (*dckb_cell_cnt >= MAX_SWAP_CELLS) {
-          return ERROR_DCKB_TOO_MANY_SWAPS;
+        TokenInfo *item = ARENA_PUSH(view->arena, view->output_dckb);
+        if (item == NULL) {
+          return ERROR_ARENA_EXHAUSTED;
         }
-        int new_i = *dckb_cell_cnt;
-        *dckb_cell_cnt += 1;
-        dckb_cell[new_i].amount = amount;
-        dckb_cell[new_i].block_number = block_number;
+        item->amount = amount;
+        item->block_number = block_number;
+        item->cell_index = i;
       }
     }
   next:
@@ -349,143 +1075,15 @@ int fetch_outputs(const uint8_t dckb_type_hash[HASH_SIZE],
   return CKB_SUCCESS;
 }
 
-int load_witness_lock_args(uint64_t index, uint64_t source, uint8_t *lock_arg,
-                           size_t lock_arg_len) {
-  int ret;
-  uint64_t len = MAX_WITNESS_SIZE;
-  uint8_t witness[MAX_WITNESS_SIZE];
-  ret = ckb_load_witness(witness, &len, 0, index, source);
+/* scan inputs and outputs once */
+int load_tx_view(const TxViewConfig *config, TxView *view) {
+  int ret = fetch_inputs(config, view);
+  LOG_DEBUG("fetch inputs ret %d", ret);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  if (len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_TOO_LONG;
-  }
-
-  mol_seg_t witness_seg;
-  witness_seg.ptr = (uint8_t *)witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_LOAD_WITNESS_ARGS;
-  }
-  /* Load type args */
-  mol_seg_t lock_seg = MolReader_WitnessArgs_get_lock(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&lock_seg)) {
-    return ERROR_LOAD_WITNESS_ARGS;
-  }
-
-  mol_seg_t lock_bytes_seg = MolReader_Bytes_raw_bytes(&lock_seg);
-  if (lock_bytes_seg.size != lock_arg_len) {
-    return ERROR_LOAD_WITNESS_ARGS;
-  }
-  memcpy(lock_arg, lock_bytes_seg.ptr, lock_arg_len);
-  return CKB_SUCCESS;
-}
-
-int search_dao_header_data(uint64_t expected_block_number,
-                           dao_header_data_t *dao_header_data) {
-  int ret;
-  int i = 0;
-  while (1) {
-    ret = load_dao_header_data(i, CKB_SOURCE_HEADER_DEP, dao_header_data);
-    if (ret != CKB_SUCCESS) {
-      return ERROR_LOAD_HEADER;
-    }
-    // find the header
-    if (dao_header_data->block_number == expected_block_number) {
-      return CKB_SUCCESS;
-    }
-    i++;
-  }
-
-  return ERROR_LOAD_HEADER;
+  ret = fetch_outputs(config, view);
+  LOG_DEBUG("fetch outputs ret %d", ret);
+  return ret;
 }
 
-int load_align_target_dao_header_data(uint64_t i, uint64_t source,
-                                      dao_header_data_t *dao_header_data) {
-  int ret;
-  uint64_t len = 0;
-  uint8_t witness[MAX_WITNESS_SIZE];
-
-  len = MAX_WITNESS_SIZE;
-  ret = ckb_load_witness(witness, &len, 0, i, source);
-  if (ret != CKB_SUCCESS) {
-    return ERROR_LOAD_DAO_HEADER_DATA;
-  }
-  if (len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_TOO_LONG;
-  }
-
-  mol_seg_t witness_seg;
-  witness_seg.ptr = (uint8_t *)witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
-    return ERROR_LOAD_WITNESS_ARGS;
-  }
-  /* Load type args */
-  mol_seg_t type_seg = MolReader_WitnessArgs_get_input_type(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&type_seg)) {
-    printf("type_seg is none");
-    return ERROR_LOAD_DAO_HEADER_DATA;
-  }
-
-  mol_seg_t type_bytes_seg = MolReader_Bytes_raw_bytes(&type_seg);
-  // load align target block number from witness
-  if (type_bytes_seg.size != 8) {
-    printf("bytes len is %d", type_bytes_seg.size);
-    return ERROR_LOAD_DAO_HEADER_DATA;
-  }
-
-  uint64_t align_target_block_number = *(uint64_t *)type_bytes_seg.ptr;
-
-  ret = search_dao_header_data(align_target_block_number, dao_header_data);
-  printf("load dao header number %ld ret %d", align_target_block_number, ret);
-  if (ret != CKB_SUCCESS) {
-    return ERROR_LOAD_HEADER;
-  }
-  return CKB_SUCCESS;
-}
-
-int align_dckb_cell(size_t i, size_t source,
-                    dao_header_data_t align_target_data,
-                    uint64_t deposited_block_number, uint64_t original_capacity,
-                    uint64_t *calculated_capacity) {
-  dao_header_data_t deposit_data;
-
-  /* new dckb */
-  if (deposited_block_number == 0) {
-    int ret = load_dao_header_data(i, source, &deposit_data);
-    printf("new dckb deposit block ret %d", ret);
-    if (ret != CKB_SUCCESS) {
-      return ERROR_LOAD_DAO_HEADER_DATA;
-    }
-    printf("new dckb deposit block %ld", deposit_data.block_number);
-    deposited_block_number = deposit_data.block_number;
-  } else {
-    int ret = search_dao_header_data(deposited_block_number, &deposit_data);
-    printf("load dao header data by cell i %ld source %ld ret %d", i, source,
-           ret);
-    if (ret != CKB_SUCCESS) {
-      return ERROR_LOAD_DAO_HEADER_DATA;
-    }
-  }
-
-  if (align_target_data.block_number == deposited_block_number) {
-    *calculated_capacity = original_capacity;
-    return CKB_SUCCESS;
-  }
-
-  if (align_target_data.block_number < deposited_block_number) {
-    printf("align error target number %ld deposit number %ld",
-           align_target_data.block_number, deposited_block_number);
-    return ERROR_DCKB_ALIGN;
-  }
-
-  return calculate_dao_input_capacity(0, deposit_data, align_target_data,
-                                      deposited_block_number, original_capacity,
-                                      calculated_capacity);
-}
@@ -15,6 +15,13 @@
  * 2. All inputs have `since` field:
  *   a. the `since` flags is set to relative epochs
  *   b. the `since` value is greater than or equals to PHASE2_TIMEOUT_SINCE
+ *
+ * Cost:
+ * Both paths start with the witness load that picks the path. The input path
+ * then loads the 85 bytes script and the lock hash of the unlock input. The
+ * timeout path loads one 8 bytes since per group input and returns on the
+ * first one that fails, there is nothing left to fuse: a since can't be read
+ * with the witness or the script, and each input is one syscall already.
  */
 
 #include "ckb_utils.h"
@@ -23,29 +30,34 @@
 /* since relative time 42 epochs(~ 7 days) */
 #define PHASE2_TIMEOUT_SINCE 0xa00001000000002a
 
-int check_unlock_via_input(uint8_t unlock_input_cell_index) {
-  uint8_t script[MAX_SCRIPT_SIZE];
-  uint64_t len = MAX_SCRIPT_SIZE;
+/* load the args of the running script, a lock hash. Only a script of 32 bytes
+ * args is loaded, its layout is verified before the args are read */
+int load_args_lock_hash(uint8_t args[HASH_SIZE]) {
+  uint8_t script[SCRIPT_SIZE_WITH_ARGS(HASH_SIZE)];
+  uint64_t len = SCRIPT_SIZE_WITH_ARGS(HASH_SIZE);
   int ret = ckb_checked_load_script(script, &len, 0);
+  /* a longer script */
+  if (ret == CKB_LENGTH_NOT_ENOUGH) {
+    return ERROR_ENCODING;
+  }
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  if (len > MAX_SCRIPT_SIZE) {
-    return ERROR_ENCODING;
+  ret = verify_script_layout(script, len, HASH_SIZE);
+  if (ret != CKB_SUCCESS) {
+    return ret;
   }
+  memcpy(args, script + SCRIPT_ARGS_OFFSET, HASH_SIZE);
+  return CKB_SUCCESS;
+}
 
-  mol_seg_t script_seg;
-  script_seg.ptr = (uint8_t *)script;
-  script_seg.size = len;
-
-  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
-  }
-  mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
-  mol_seg_t raw_args_seg = MolReader_Bytes_raw_bytes(&args_seg);
-  if (raw_args_seg.size != HASH_SIZE) {
-    return ERROR_ENCODING;
+int check_unlock_via_input(uint8_t unlock_input_cell_index) {
+  uint8_t args[HASH_SIZE];
+  int ret = load_args_lock_hash(args);
+  if (ret != CKB_SUCCESS) {
+    return ret;
   }
+  uint64_t len;
   /* read unlock input cell lock_hash */
   uint8_t lock_hash[HASH_SIZE];
   len = HASH_SIZE;
@@ -55,7 +67,7 @@ int check_unlock_via_input(uint8_t unlock_input_cell_index) {
   if (ret != CKB_SUCCESS || len != HASH_SIZE) {
     return ERROR_ENCODING;
   }
-  ret = memcmp(lock_hash, raw_args_seg.ptr, HASH_SIZE);
+  ret = memcmp(lock_hash, args, HASH_SIZE);
   if (ret != 0) {
     return ERROR_CL_MISMATCH_LOCK_HASH;
   }
@@ -92,9 +104,11 @@ int check_unlock_via_timeout() {
 }
 
 int main() {
+  MARK_PHASE("start");
   uint8_t unlock_input_cell_index;
   int ret = load_witness_lock_args(0, CKB_SOURCE_GROUP_INPUT,
                                    &unlock_input_cell_index, 1);
+  MARK_PHASE("witness");
   if (ret == CKB_SUCCESS) {
     /* unlock via input cell */
     ret = check_unlock_via_input(unlock_input_cell_index);
@@ -108,5 +122,6 @@ int main() {
       return ret;
     }
   }
+  MARK_PHASE("done");
   return CKB_SUCCESS;
 }
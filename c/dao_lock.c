@@ -16,13 +16,42 @@
  *
  * phase1:
  * 1. check `inputs DCKB - outputs DCKB = X`.
- * 2. has one output custodian cell which type is DCKB and lock is
- * custodian_lock, and cell's dckb amount equals to X.
+ * 2. has output custodian cells which type is DCKB and lock is
+ * custodian_lock, and cells' dckb amount sums to X.
  *
  * phase2:
- * 1. check `inputs DCKB - outputs DCKB = Y`.
+ * 1. check `inputs DCKB - outputs DCKB = Y`, by the destroy amount that DCKB
+ * verified in the witness (see dckb.c) if given, otherwise inputs DCKB are
+ * aligned here.
  * 2. has the custodian cell in phase1 as input.
  *
+ * Batch:
+ * Lock groups of different refund locks can share a custodian cell, e.g. an
+ * exchange withdraws for many users in one transaction. The groups of this
+ * lock in the same withdraw phase form the batch of a transaction, X (or Y)
+ * is summed over the NervosDAO inputs of all of them instead of the group's
+ * inputs, so a transaction settles its batch at once.
+ * phase1: either every group points at its own custodian outputs, which hold
+ * X of the group, and all custodian outputs of the transaction hold X of the
+ * batch, or every group of a batch points at the same single custodian
+ * output, which holds X of the whole batch, and every cell of the batch must
+ * custody some DCKB. A transaction mixing the two is rejected.
+ * phase2: a custodian cell holding more than X of the group backs a batch. It
+ * must be unlocked together with all NervosDAO cells created in its
+ * transaction, whose custody covers its amount, so no cell of the batch is
+ * left without its custodian. Y of the batch is checked only by the lead
+ * group, the group of the first NervosDAO input of the batch: every group of
+ * the batch runs this same code over the same cells, so the check would be
+ * the same in each.
+ * Cost: of a batch of G groups and N NervosDAO inputs, every group finds the
+ * batch cells by their locks, the lock cache misses beyond 4 refund locks, so
+ * up to N lock loads each. In phase2 every group with a shared custodian loads the N
+ * out points, in phase1 every group with its own custodian loads the output
+ * locks. These are cheap fixed-size loads but grow with G * N. Headers,
+ * witnesses and the DCKB alignment of phase2 are loaded for the group's own
+ * cells, and once for the batch by the lead, so they grow with N. See the
+ * batch scenarios of src/tests/bench.rs.
+ *
  * HINT: we use the custodian cell to handle withdraw unlock and timeout, check
  * custodian_lock for details.
  *
@@ -32,191 +61,187 @@
  * <refund lock hash>: lock hash that receives the refund CKB
  *
  * Witness args:
- * This script expect a WitnessArgs and its lock:
- * <custodian index>: a uint8_t index refer to custodian cell.
+ * This script expect a WitnessArgs of the first group input and its lock:
+ * phase1: <custodian index>...
+ * phase2: <custodian index> | [<deposit header index>...]
+ * <custodian index>: a uint8_t index refer to custodian cell, phase1 accepts
+ * several custodian outputs of the group in ascending order, a custodian
+ * shared by a batch is the only one.
+ * <deposit header index>: optional, uint8_t header deps indexes of the
+ * deposit headers, one for each group input in order. Without them the index
+ * is read from the witness of each input, as NervosDAO does.
  */
 
 #include "ckb_utils.h"
 #include "common.h"
 #include "custodian_lock.h"
 
-/* load dckb type hash from script.args */
-int load_dckb_type_hash(uint8_t dckb_type_hash[HASH_SIZE],
-                        uint8_t refund_lock_hash[HASH_SIZE]) {
-  int ret;
-  uint64_t len = 0;
-  uint8_t script[MAX_SCRIPT_SIZE];
-
-  len = MAX_SCRIPT_SIZE;
-  ret = ckb_checked_load_script(script, &len, 0);
+/* script.args is dckb type hash | refund lock hash */
+#define DL_ARGS_SIZE (HASH_SIZE * 2)
+#define DL_ARGS_DCKB_TYPE_HASH(context) ((context)->args)
+#define DL_ARGS_REFUND_LOCK_HASH(context) ((context)->args + HASH_SIZE)
+
+/* witness_args.lock of the first group input */
+typedef struct {
+  /* phase1 custodian output indexes, phase2 uses the first as the custodian
+   * input index */
+  const uint8_t *custodian_indexes;
+  uint32_t custodian_cnt;
+  /* phase2, deposit header indexes of group inputs, NULL if not packed */
+  const uint8_t *header_indexes;
+} GroupWitness;
+
+int load_group_witness(const TxView *view, GroupWitness *group_witness) {
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, 0, CKB_SOURCE_GROUP_INPUT);
   if (ret != CKB_SUCCESS) {
-    return ret;
+    return ERROR_DL_NO_CUSTODIAN_CELL_INDEX;
   }
-  if (len > MAX_SCRIPT_SIZE) {
-    return ERROR_ENCODING;
+  uint32_t lock_len = witness.field_size[WITNESS_ARGS_LOCK];
+  if (lock_len == 0) {
+    return ERROR_DL_NO_CUSTODIAN_CELL_INDEX;
   }
-
-  mol_seg_t script_seg;
-  script_seg.ptr = (uint8_t *)script;
-  script_seg.size = len;
-
-  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
+  uint8_t *lock = arena_alloc(view->arena, lock_len);
+  if (lock == NULL) {
+    return ERROR_ARENA_EXHAUSTED;
   }
-  /* Load type args */
-  mol_seg_t args_seg = MolReader_Script_get_args(&script_seg);
-
-  mol_seg_t raw_args_seg = MolReader_Bytes_raw_bytes(&args_seg);
-  if (raw_args_seg.size != HASH_SIZE * 2) {
-    return ERROR_ENCODING;
+  ret = load_witness_args_field(&witness, WITNESS_ARGS_LOCK, lock, lock_len);
+  if (ret != CKB_SUCCESS) {
+    return ERROR_DL_NO_CUSTODIAN_CELL_INDEX;
   }
-
-  memcpy(dckb_type_hash, raw_args_seg.ptr, HASH_SIZE);
-  memcpy(refund_lock_hash, raw_args_seg.ptr + HASH_SIZE, HASH_SIZE);
+  group_witness->custodian_indexes = lock;
+  group_witness->custodian_cnt = lock_len;
+  group_witness->header_indexes =
+      lock_len == 1 + (uint32_t)view->group_dao_cnt ? lock + 1 : NULL;
   return CKB_SUCCESS;
 }
 
-/* load custodian cell index from witness_args.lock */
-int load_custodian_cell_index(uint8_t *index) {
-  int ret = load_witness_lock_args(0, CKB_SOURCE_GROUP_INPUT, index, 1);
-  if (ret == CKB_ITEM_MISSING) {
-    return ERROR_DL_NO_CUSTODIAN_CELL_INDEX;
-  }
-  if (ret != CKB_SUCCESS) {
+/* phase2 witness is one custodian index, optionally with header indexes */
+int check_phase2_group_witness(const GroupWitness *group_witness) {
+  if (group_witness->custodian_cnt != 1 &&
+      group_witness->header_indexes == NULL) {
     return ERROR_DL_NO_CUSTODIAN_CELL_INDEX;
   }
   return CKB_SUCCESS;
 }
 
-/* check validity of custodian cell
- */
-int check_custodian_cell(uint8_t dckb_type_hash[HASH_SIZE], uint64_t i,
-                         uint64_t source) {
-  uint8_t type_hash[HASH_SIZE];
-  uint64_t len = HASH_SIZE;
-  /* check cell type must be DCKB */
-  int ret = ckb_checked_load_cell_by_field(type_hash, &len, 0, i, source,
-                                           CKB_CELL_FIELD_TYPE_HASH);
-  printf("check load custodian type hash ret %i", ret);
-  if (ret == CKB_ITEM_MISSING) {
-    return ERROR_DL_INVALID_CUSTODIAN_CELL;
-  }
-  if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-    return ERROR_ENCODING;
+/* input DCKB are recorded in inputs order, find one by binary search,
+ * returns NULL if input i is not DCKB */
+const TokenInfo *find_input_dckb(const TxView *view, uint64_t i) {
+  int lo = 0;
+  int hi = view->input_dckb_cnt;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (view->input_dckb[mid].cell_index < i) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
-  ret = memcmp(type_hash, dckb_type_hash, HASH_SIZE);
-  printf("check custodian type ret %i", ret);
-  if (ret != 0) {
-    return ERROR_DL_INVALID_CUSTODIAN_CELL;
+  if (lo < view->input_dckb_cnt && view->input_dckb[lo].cell_index == i) {
+    return &view->input_dckb[lo];
   }
-  /* check cell lock must be custodian_lock */
-  uint8_t lock_buf[MAX_SCRIPT_SIZE];
-  len = MAX_SCRIPT_SIZE;
-  ret = ckb_checked_load_cell_by_field(lock_buf, &len, 0, i, source,
-                                       CKB_CELL_FIELD_LOCK);
+  return NULL;
+}
 
-  if (ret != CKB_SUCCESS || len > MAX_SCRIPT_SIZE) {
-    return ERROR_ENCODING;
+/* check validity of custodian cell, the type of an input that fetch_inputs
+ * classified as DCKB is not loaded again
+ */
+int check_custodian_cell(const ScriptContext *context, const TxView *view,
+                         uint64_t i, uint64_t source) {
+  int ret;
+  if (source != CKB_SOURCE_INPUT || find_input_dckb(view, i) == NULL) {
+    uint8_t type_hash[HASH_SIZE];
+    uint64_t len = HASH_SIZE;
+    /* check cell type must be DCKB */
+    ret = ckb_checked_load_cell_by_field(type_hash, &len, 0, i, source,
+                                         CKB_CELL_FIELD_TYPE_HASH);
+    LOG_DEBUG("check load custodian type hash ret %i", ret);
+    if (ret == CKB_ITEM_MISSING) {
+      return ERROR_DL_INVALID_CUSTODIAN_CELL;
+    }
+    if (ret != CKB_SUCCESS || len != HASH_SIZE) {
+      return ERROR_ENCODING;
+    }
+    ret = memcmp(type_hash, DL_ARGS_DCKB_TYPE_HASH(context), HASH_SIZE);
+    LOG_DEBUG("check custodian type ret %i", ret);
+    if (ret != 0) {
+      return ERROR_DL_INVALID_CUSTODIAN_CELL;
+    }
   }
-  mol_seg_t script_seg;
-  script_seg.ptr = lock_buf;
-  script_seg.size = len;
-  if (MolReader_Script_verify(&script_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
+  /* check cell lock must be custodian_lock, custodian args is a lock hash */
+  uint8_t custodian_args[HASH_SIZE];
+  ret = load_cell_lock_args(context->custodian_lock_code_hash, i, source,
+                            custodian_args, HASH_SIZE);
+  if (ret == ERROR_INCORRECT_LOCK) {
+    LOG_ERROR("custodian lock error");
+    return ERROR_DL_INVALID_CUSTODIAN_CELL;
   }
-  /* Load code hash */
-  mol_seg_t code_hash_seg = MolReader_Script_get_code_hash(&script_seg);
-  if (code_hash_seg.size != HASH_SIZE) {
-    return ERROR_ENCODING;
+  return ret;
+}
+
+/* view only records NervosDAO cells of the lock group, the group must not
+ * contain other cells */
+int check_group_inputs(const TxView *view) {
+  if (view->group_dao_cnt == 0) {
+    return ERROR_DL_CONFLICT_DAO_TYPE_HASH;
   }
-  mol_seg_t hash_type_seg = MolReader_Script_get_hash_type(&script_seg);
-  if (hash_type_seg.size != 1) {
-    return ERROR_ENCODING;
+  uint64_t capacity;
+  uint64_t len = CKB_LEN;
+  int ret = ckb_load_cell_by_field((uint8_t *)&capacity, &len, 0,
+                                   view->group_dao_cnt, CKB_SOURCE_GROUP_INPUT,
+                                   CKB_CELL_FIELD_CAPACITY);
+  if (ret != CKB_INDEX_OUT_OF_BOUND) {
+    return ERROR_DL_CONFLICT_DAO_TYPE_HASH;
   }
+  return CKB_SUCCESS;
+}
 
-  if (*(hash_type_seg.ptr) != HASH_TYPE_DATA) {
-    printf("custodian lock hash type error");
-    return ERROR_DL_INVALID_CUSTODIAN_CELL;
-  }
-  ret = memcmp(code_hash_seg.ptr, CUSTODIAN_LOCK_CODE_HASH, HASH_SIZE);
-  if (ret != 0) {
-    printf("custodian lock code hash error");
-    return ERROR_DL_INVALID_CUSTODIAN_CELL;
+/* DCKB custodied by a NervosDAO cell in phase1, the original deposited
+ * capacity minus the occupied capacity */
+int load_custody_amount(const TokenInfo *cell, uint64_t *amount) {
+  if (__builtin_usubl_overflow(cell->amount, DAO_OCCUPIED_CAPACITY, amount)) {
+    return ERROR_OVERFLOW;
   }
   return CKB_SUCCESS;
 }
 
-/* check withdraw unlock condition
+/* check withdraw unlock condition of NervosDAO inputs
  * phase1: expected custodian original deposited capacity
  * phase2: expected destroy total withdraw capacity
+ * header_indexes are the deposit header indexes of cells, NULL if not given
  */
-int check_withdraw_unlock_condition(int *is_phase1,
+int check_withdraw_unlock_condition(header_table_t *header_table,
+                                    const TokenInfo *cells, int cells_cnt,
+                                    const uint8_t *header_indexes,
+                                    int *is_phase1,
                                     uint64_t *expected_custodian_amount) {
   int ret;
-  uint64_t len;
-  int i = 0;
-  /*
-   * We assume inputs cells are NervosDAO cells,
-   * input cells withdraw phase must be same.
-   */
-  uint8_t cell_data[BLOCK_NUM_LEN];
-  uint8_t nervos_dao_type_hash[HASH_SIZE];
-  uint8_t type_hash[HASH_SIZE];
+  /* input cells withdraw phase must be same. */
   *expected_custodian_amount = 0;
-  while (1) {
-    len = BLOCK_NUM_LEN;
-    ret = ckb_load_cell_data(cell_data, &len, 0, i, CKB_SOURCE_GROUP_INPUT);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS || len != BLOCK_NUM_LEN) {
-      return ERROR_ENCODING;
-    }
+  for (int i = 0; i < cells_cnt; i++) {
+    const TokenInfo *cell = &cells[i];
+    /* withdrawing cell data is the deposited block number */
+    int is_input_cell_phase1 = cell->block_number != 0;
     /* check withdraw phase */
     if (i == 0) {
       /* first cell, initialize is_phase1 */
-      *is_phase1 = is_dao_withdraw1_cell(cell_data, len);
+      *is_phase1 = is_input_cell_phase1;
     }
-    int is_input_cell_phase1 = is_dao_withdraw1_cell(cell_data, len);
-    printf("i=%d withdraw phase: %d is_input_cell_phase1=%d", i, *is_phase1,
-           is_input_cell_phase1);
+    LOG_TRACE("i=%d withdraw phase: %d is_input_cell_phase1=%d", i, *is_phase1,
+              is_input_cell_phase1);
     /* inputs must be same withdraw phase */
     if (*is_phase1 != is_input_cell_phase1) {
       return ERROR_DL_CONFLICT_WITHDRAW_PHASE;
     }
-    /* check type hash */
-    len = HASH_SIZE;
-    ret = ckb_checked_load_cell_by_field(type_hash, &len, 0, i,
-                                         CKB_SOURCE_GROUP_INPUT,
-                                         CKB_CELL_FIELD_TYPE_HASH);
-    if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-      return ERROR_ENCODING;
-    }
-    if (i == 0) {
-      /* first cell, initialize nervos_dao_type_hash */
-      memcpy(nervos_dao_type_hash, type_hash, HASH_SIZE);
-    } else {
-      /* inputs must have same type hash */
-      ret = memcmp(nervos_dao_type_hash, type_hash, HASH_SIZE);
-      if (ret != 0) {
-        return ERROR_DL_CONFLICT_DAO_TYPE_HASH;
-      }
-    }
     /* calculate expected amount */
-    uint64_t original_capacity;
-    len = CKB_LEN;
-    ret = ckb_checked_load_cell_by_field((uint8_t *)&original_capacity, &len, 0,
-                                         i, CKB_SOURCE_GROUP_INPUT,
-                                         CKB_CELL_FIELD_CAPACITY);
-    if (ret != CKB_SUCCESS || len != CKB_LEN) {
-      return ERROR_LOAD_CAPACITY;
-    }
+    uint64_t original_capacity = (uint64_t)cell->amount;
     if (!is_input_cell_phase1) {
       /* current tx is phase1 withdraw */
       uint64_t efficient_capacity;
-      if (__builtin_usubl_overflow(original_capacity, DAO_OCCUPIED_CAPACITY,
-                                   &efficient_capacity)) {
-        return ERROR_OVERFLOW;
+      ret = load_custody_amount(cell, &efficient_capacity);
+      if (ret != CKB_SUCCESS) {
+        return ret;
       }
       if (__builtin_uaddl_overflow(*expected_custodian_amount,
                                    efficient_capacity,
@@ -227,24 +252,28 @@ int check_withdraw_unlock_condition(int *is_phase1,
       /* current tx is phase2 withdraw */
       /* load DAO deposit header */
       size_t header_index;
-      ret = extract_deposit_header_index(i, &header_index);
-      if (ret != CKB_SUCCESS) {
-        return ERROR_LOAD_HEADER_INDEX;
+      if (header_indexes != NULL) {
+        header_index = header_indexes[i];
+      } else {
+        ret = extract_deposit_header_index(cell->cell_index, &header_index);
+        if (ret != CKB_SUCCESS) {
+          return ERROR_LOAD_HEADER_INDEX;
+        }
       }
       dao_header_data_t deposit_data;
-      ret = load_dao_header_data(header_index, CKB_SOURCE_HEADER_DEP,
-                                 &deposit_data);
+      ret = header_table_get(header_table, header_index, &deposit_data);
       if (ret != CKB_SUCCESS) {
         return ERROR_LOAD_HEADER;
       }
       /* load DAO withdraw header */
       dao_header_data_t target_data;
-      ret = load_dao_header_data(i, CKB_SOURCE_GROUP_INPUT, &target_data);
+      ret = load_dao_header_data(cell->cell_index, CKB_SOURCE_INPUT,
+                                 &target_data);
       if (ret != CKB_SUCCESS) {
         return ERROR_LOAD_HEADER;
       }
       /* calculate withdraw amount */
-      uint64_t deposited_block_number = *(uint64_t *)cell_data;
+      uint64_t deposited_block_number = cell->block_number;
       uint64_t calculated_capacity;
       ret = calculate_dao_input_capacity(
           DAO_OCCUPIED_CAPACITY, deposit_data, target_data,
@@ -253,293 +282,562 @@ int check_withdraw_unlock_condition(int *is_phase1,
         return ret;
       }
       /* accumulate compensation */
-      *expected_custodian_amount = calculated_capacity;
+      if (__builtin_uaddl_overflow(*expected_custodian_amount,
+                                   calculated_capacity,
+                                   expected_custodian_amount)) {
+        return ERROR_OVERFLOW;
+      }
     }
-    i++;
   }
   return CKB_SUCCESS;
 }
 
-int load_out_point_seg(uint64_t i, uint64_t source, uint8_t buf[OUT_POINT_SIZE],
-                       mol_seg_t *out_point_seg) {
-  uint64_t len = OUT_POINT_SIZE;
-  int ret = ckb_load_input_by_field(buf, &len, 0, i, source,
+/* load the tx hash of an input out point, OutPoint is a fixed struct
+ * tx_hash(32) | index(4), so only the tx hash is loaded */
+int load_out_point_tx_hash(uint64_t i, uint64_t source,
+                           uint8_t tx_hash[HASH_SIZE]) {
+  uint64_t len = HASH_SIZE;
+  int ret = ckb_load_input_by_field(tx_hash, &len, 0, i, source,
                                     CKB_INPUT_FIELD_OUT_POINT);
-  printf("load input out point %ld, ret %d", i, ret);
+  LOG_TRACE("load input out point %ld, ret %d", i, ret);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
   if (len != OUT_POINT_SIZE) {
     return ERROR_ENCODING;
   }
-
-  out_point_seg->ptr = (uint8_t *)buf;
-  out_point_seg->size = len;
-
-  if (MolReader_OutPoint_verify(out_point_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
-  }
-
   return CKB_SUCCESS;
 }
 
-/* phase1 should output one custodian cell
- * 1. custodian cell should be validity
- * 2. DCKB amount should satisfied expected custodian amount
- */
-int check_phase1_custodian_cell(uint8_t dckb_type_hash[HASH_SIZE],
-                                uint64_t custodian_cell_i,
-                                uint64_t expected_custodian_amount) {
+/* phase1 output custodian cell should be validity, load its DCKB amount */
+int load_phase1_custodian_cell(const ScriptContext *context,
+                               const TxView *view, uint64_t custodian_cell_i,
+                               uint128_t *amount) {
   /* check custodian cell */
-  int ret =
-      check_custodian_cell(dckb_type_hash, custodian_cell_i, CKB_SOURCE_OUTPUT);
-  printf("phase1 check custodian cell ret %d", ret);
+  int ret = check_custodian_cell(context, view, custodian_cell_i,
+                                 CKB_SOURCE_OUTPUT);
+  LOG_DEBUG("phase1 check custodian cell ret %d", ret);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
   /* check custodian DCKB */
-  uint8_t buf[BLOCK_NUM_LEN + UDT_LEN];
-  uint64_t len = BLOCK_NUM_LEN + UDT_LEN;
+  uint8_t buf[DCKB_DATA_LEN];
+  uint64_t len = DCKB_DATA_LEN;
   ret = ckb_load_cell_data(buf, &len, 0, custodian_cell_i, CKB_SOURCE_OUTPUT);
-  if (ret != CKB_SUCCESS || len != UDT_LEN + BLOCK_NUM_LEN) {
+  if (ret != CKB_SUCCESS || len > DCKB_DATA_LEN) {
     return ERROR_DL_INVALID_CUSTODIAN_CELL;
   }
-  uint128_t amount;
   uint64_t block_number;
-  ret = parse_dckb_data(&amount, &block_number, buf, len);
+  ret = parse_dckb_data(amount, &block_number, buf, len);
   if (ret != CKB_SUCCESS) {
     return ERROR_DL_INVALID_CUSTODIAN_CELL;
   }
-  if (amount != expected_custodian_amount) {
-    return ERROR_DL_INCORRECT_DESTROY_AMOUNT;
+  return CKB_SUCCESS;
+}
+
+/* phase1 should output custodian cells
+ * 1. custodian cells should be validity
+ * 2. total DCKB amount of them should satisfied expected custodian amount,
+ * checked by the caller
+ */
+int load_phase1_custodian_amount(const ScriptContext *context,
+                                 const TxView *view,
+                                 const GroupWitness *group_witness,
+                                 uint128_t *total_amount) {
+  *total_amount = 0;
+  for (uint32_t k = 0; k < group_witness->custodian_cnt; k++) {
+    uint64_t custodian_cell_i = group_witness->custodian_indexes[k];
+    /* ascending, so a custodian cell is counted once */
+    if (k > 0 && custodian_cell_i <= group_witness->custodian_indexes[k - 1]) {
+      return ERROR_DL_INVALID_CUSTODIAN_CELL;
+    }
+    uint128_t amount;
+    int ret =
+        load_phase1_custodian_cell(context, view, custodian_cell_i, &amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    *total_amount += amount;
+    if (*total_amount < amount) {
+      return ERROR_OVERFLOW;
+    }
   }
   return CKB_SUCCESS;
 }
 
 /* phase2 custodian cell
  * 1. custodian cell should be validity
- * 2. all inputs and custodian cell are from the same tx
+ * 2. all inputs and custodian cell are from the same tx, which tx hash is
+ * loaded into custodian_cell_tx_hash
  */
-int check_phase2_custodian_cell(uint8_t dckb_type_hash[HASH_SIZE],
-                                uint64_t custodian_cell_i) {
+int check_phase2_custodian_cell(const ScriptContext *context,
+                                const TxView *view, uint64_t custodian_cell_i,
+                                uint8_t custodian_cell_tx_hash[HASH_SIZE]) {
   /* check custodian cell */
   int ret =
-      check_custodian_cell(dckb_type_hash, custodian_cell_i, CKB_SOURCE_INPUT);
-  printf("phase2 check custodian cell i %ld ret %d", custodian_cell_i, ret);
+      check_custodian_cell(context, view, custodian_cell_i, CKB_SOURCE_INPUT);
+  LOG_DEBUG("phase2 check custodian cell i %ld ret %d", custodian_cell_i, ret);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
   /* load custodian cell outpoint */
-  uint8_t custodian_cell_tx_hash[HASH_SIZE];
-  uint8_t buf[OUT_POINT_SIZE];
-  mol_seg_t out_point_seg;
-  ret = load_out_point_seg(custodian_cell_i, CKB_SOURCE_INPUT, buf,
-                           &out_point_seg);
-  printf("load out point ret %d", ret);
+  ret = load_out_point_tx_hash(custodian_cell_i, CKB_SOURCE_INPUT,
+                               custodian_cell_tx_hash);
+  LOG_DEBUG("load out point ret %d", ret);
   if (ret != CKB_SUCCESS) {
     return ERROR_LOAD_OUT_POINT;
   }
-  mol_seg_t tx_hash_seg = MolReader_OutPoint_get_tx_hash(&out_point_seg);
-  if (tx_hash_seg.size != HASH_SIZE) {
-    return ERROR_ENCODING;
-  }
-  memcpy(custodian_cell_tx_hash, tx_hash_seg.ptr, HASH_SIZE);
 
-  /* check inputs outpoints */
-  int i = 0;
-  while (1) {
-    ret = load_out_point_seg(i, CKB_SOURCE_GROUP_INPUT, buf, &out_point_seg);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
+  /* check inputs outpoints, the group is exactly the recorded group_dao */
+  for (int i = 0; i < view->group_dao_cnt; i++) {
+    uint8_t tx_hash[HASH_SIZE];
+    ret = load_out_point_tx_hash(view->group_dao[i].cell_index,
+                                 CKB_SOURCE_INPUT, tx_hash);
     if (ret != CKB_SUCCESS) {
       return ERROR_LOAD_OUT_POINT;
     }
-
-    /* Load tx hash */
-    tx_hash_seg = MolReader_OutPoint_get_tx_hash(&out_point_seg);
-    if (tx_hash_seg.size != HASH_SIZE) {
-      return ERROR_ENCODING;
-    }
-    ret = memcmp(custodian_cell_tx_hash, tx_hash_seg.ptr, HASH_SIZE);
+    ret = memcmp(custodian_cell_tx_hash, tx_hash, HASH_SIZE);
     if (ret != 0) {
       return ERROR_DL_MISMATCH_CUSTODIAN_CELL_TX_HASH;
     }
-
-    i++;
   }
   return CKB_SUCCESS;
 }
 
-/* assert input group cell's capacity equals to outputs(where
- * lock=refund_lock_hash) cell's capacity  */
-int check_refund_ckb_cell(uint8_t refund_lock_hash[HASH_SIZE]) {
-  int i = 0;
-  uint64_t input_cells_capacity = 0;
-  while (1) {
-    uint64_t capacity = 0;
-    uint64_t len = CKB_LEN;
-    int ret = ckb_checked_load_cell_by_field((uint8_t *)&capacity, &len, 0, i,
-                                             CKB_SOURCE_GROUP_INPUT,
-                                             CKB_CELL_FIELD_CAPACITY);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
-    }
-    if (ret != CKB_SUCCESS || len != CKB_LEN) {
-      return ERROR_ENCODING;
+/* phase2 custodian cell must not hold more DCKB than the NervosDAO cells it
+ * backs custody, see Batch. Only a custodian beyond the group's custody is
+ * shared, then the batch cells created in its transaction are counted.
+ */
+int check_phase2_custodian_amount(
+    const TxView *view, uint64_t custodian_cell_i,
+    const uint8_t custodian_cell_tx_hash[HASH_SIZE]) {
+  /* check_custodian_cell checked it is an input DCKB */
+  const TokenInfo *custodian = find_input_dckb(view, custodian_cell_i);
+  if (custodian == NULL) {
+    return ERROR_DL_INVALID_CUSTODIAN_CELL;
+  }
+  uint64_t custody_amount = 0;
+  for (int i = 0; i < view->group_dao_cnt; i++) {
+    uint64_t amount;
+    int ret = load_custody_amount(&view->group_dao[i], &amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
     }
-    if (__builtin_uaddl_overflow(input_cells_capacity, capacity,
-                                 &input_cells_capacity)) {
+    if (__builtin_uaddl_overflow(custody_amount, amount, &custody_amount)) {
       return ERROR_OVERFLOW;
     }
-    i++;
   }
-  uint64_t refund_capacity = 0;
-  i = 0;
-  while (1) {
-    uint8_t lock_hash[HASH_SIZE];
-    uint64_t len = HASH_SIZE;
-    int ret = ckb_checked_load_cell_by_field(
-        lock_hash, &len, 0, i, CKB_SOURCE_OUTPUT, CKB_CELL_FIELD_LOCK_HASH);
-    if (ret == CKB_INDEX_OUT_OF_BOUND) {
-      break;
+  LOG_DEBUG("custodian amount %ld, group custody %ld", custodian->amount,
+            custody_amount);
+  if (custodian->amount <= custody_amount) {
+    return CKB_SUCCESS;
+  }
+  for (int i = 0; i < view->batch_dao_cnt; i++) {
+    const TokenInfo *cell = &view->batch_dao[i];
+    /* withdrawing cells only */
+    if (cell->block_number == 0) {
+      continue;
     }
-    if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-      return ERROR_ENCODING;
+    uint8_t tx_hash[HASH_SIZE];
+    int ret =
+        load_out_point_tx_hash(cell->cell_index, CKB_SOURCE_INPUT, tx_hash);
+    if (ret != CKB_SUCCESS) {
+      return ERROR_LOAD_OUT_POINT;
     }
-    ret = memcmp(lock_hash, refund_lock_hash, HASH_SIZE);
-    if (ret != 0) {
-      goto next;
-    }
-    uint64_t capacity = 0;
-    len = CKB_LEN;
-    ret = ckb_checked_load_cell_by_field((uint8_t *)&capacity, &len, 0, i,
-                                         CKB_SOURCE_OUTPUT,
-                                         CKB_CELL_FIELD_CAPACITY);
-    if (ret != CKB_SUCCESS || len != CKB_LEN) {
-      return ERROR_ENCODING;
+    if (memcmp(tx_hash, custodian_cell_tx_hash, HASH_SIZE) != 0) {
+      continue;
     }
-    if (__builtin_uaddl_overflow(refund_capacity, capacity, &refund_capacity)) {
+    uint64_t amount;
+    ret = load_custody_amount(cell, &amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (__builtin_uaddl_overflow(custody_amount, amount, &custody_amount)) {
       return ERROR_OVERFLOW;
     }
-  next:
-    i++;
   }
-  if (refund_capacity < input_cells_capacity) {
-    return ERROR_DL_REFUND_CKB_NOT_ENOUGH;
+  LOG_DEBUG("batch custody %ld", custody_amount);
+  if (custodian->amount > custody_amount) {
+    return ERROR_DL_INCOMPLETE_BATCH;
   }
   return CKB_SUCCESS;
 }
 
-int check_destroy_dckb_amount(uint8_t dckb_type_hash[HASH_SIZE],
-                              uint64_t expected_destroy_amount) {
-  /* fetch inputs */
-  int input_dckb_cells_cnt;
-  TokenInfo input_dckb_cells[MAX_SWAP_CELLS];
-  int ret = fetch_inputs(dckb_type_hash, NULL, NULL, NULL, NULL, NULL,
-                         &input_dckb_cells_cnt, input_dckb_cells);
-  printf("fetch inputs ret %d", ret);
-  if (ret != CKB_SUCCESS) {
-    return ret;
+/* assert input group cell's capacity equals to outputs(where
+ * lock=refund_lock_hash) cell's capacity  */
+int check_refund_ckb_cell(const TxView *view) {
+  uint64_t input_cells_capacity = 0;
+  for (int i = 0; i < view->group_dao_cnt; i++) {
+    if (__builtin_uaddl_overflow(input_cells_capacity,
+                                 (uint64_t)view->group_dao[i].amount,
+                                 &input_cells_capacity)) {
+      return ERROR_OVERFLOW;
+    }
   }
-  /* fetch outputs */
-  int output_dckb_cells_cnt;
-  TokenInfo output_dckb_cells[MAX_SWAP_CELLS];
-  ret = fetch_outputs(dckb_type_hash, NULL, NULL, NULL, NULL, NULL,
-                      &output_dckb_cells_cnt, output_dckb_cells);
-  printf("fetch outputs ret %d", ret);
-  if (ret != CKB_SUCCESS) {
-    return ret;
+  if (view->refund_capacity < input_cells_capacity) {
+    return ERROR_DL_REFUND_CKB_NOT_ENOUGH;
   }
+  return CKB_SUCCESS;
+}
 
-  if (input_dckb_cells_cnt == 0) {
-    printf("input_dckb_cells_cnt %d", input_dckb_cells_cnt);
+/* destroyed DCKB, inputs DCKB (aligned) - outputs DCKB */
+int load_destroy_amount(header_table_t *header_table, const TxView *view,
+                        uint64_t *destroy_amount) {
+  if (view->input_dckb_cnt == 0) {
+    LOG_DEBUG("input_dckb_cells_cnt %d", view->input_dckb_cnt);
     return ERROR_DL_INCORRECT_DESTROY_AMOUNT;
   }
+  int ret;
+  /* DCKB checks the committed amount, no need to align inputs again */
+  if (view->first_output_dckb >= 0) {
+    int has_destroy_amount;
+    ret = load_committed_destroy_amount(view->first_output_dckb,
+                                        CKB_SOURCE_OUTPUT, &has_destroy_amount,
+                                        destroy_amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (has_destroy_amount) {
+      LOG_DEBUG("committed destroy amount %ld", *destroy_amount);
+      return CKB_SUCCESS;
+    }
+  }
   /* calculate input dckb */
   dao_header_data_t align_target_data;
-  ret = load_align_target_dao_header_data(input_dckb_cells[0].cell_index,
-                                          CKB_SOURCE_INPUT, &align_target_data);
-  printf("load aligned target ret %d", ret);
+  HeaderHints deposit_header_hints;
+  ret = load_align_target_dao_header_data(
+      header_table, view->arena, view->input_dckb[0].cell_index,
+      CKB_SOURCE_INPUT, &align_target_data, &deposit_header_hints);
+  LOG_DEBUG("load aligned target ret %d", ret);
   if (ret != CKB_SUCCESS) {
     return ERROR_LOAD_DAO_HEADER_DATA;
   }
+  /* align the cells grouped by deposit height, the deposit header of a height
+   * is searched once. Each cell is still aligned and rounded alone */
+  const uint16_t *order =
+      sort_by_height(view->arena, view->input_dckb, view->input_dckb_cnt);
+  if (order == NULL) {
+    return ERROR_ARENA_EXHAUSTED;
+  }
   uint64_t calculated_capacity;
   uint64_t total_input_dckb = 0;
-  for (int i = 0; i < input_dckb_cells_cnt; i++) {
-    printf("input amount %ld, block_number %ld",
-           (uint64_t)input_dckb_cells[i].amount,
-           input_dckb_cells[i].block_number);
-    ret = align_dckb_cell(input_dckb_cells[i].cell_index, CKB_SOURCE_INPUT,
-                          align_target_data, input_dckb_cells[i].block_number,
-                          input_dckb_cells[i].amount, &calculated_capacity);
+  /* deposit header dep of deposit_number, 0 before the first search */
+  size_t deposit_index = 0;
+  uint64_t deposit_number = 0;
+  for (int k = 0; k < view->input_dckb_cnt; k++) {
+    /* hints are indexed by the input order */
+    int i = order[k];
+    const TokenInfo *cell = &view->input_dckb[i];
+    LOG_TRACE("input amount %ld, block_number %ld", (uint64_t)cell->amount,
+              cell->block_number);
+    if (cell->block_number == 0) {
+      ret = align_dckb_cell(header_table, cell->cell_index, CKB_SOURCE_INPUT,
+                            align_target_data, cell->block_number,
+                            cell->amount, &calculated_capacity);
+    } else {
+      if (deposit_header_hints.indexes != NULL ||
+          cell->block_number != deposit_number) {
+        ret = find_deposit_header(header_table, &deposit_header_hints, i,
+                                  cell->block_number, &deposit_index);
+        if (ret != CKB_SUCCESS) {
+          return ret;
+        }
+        deposit_number = cell->block_number;
+      }
+      ret = align_deposited_amount(header_table, deposit_index,
+                                   align_target_data, cell->amount,
+                                   &calculated_capacity);
+    }
     if (ret != CKB_SUCCESS) {
       return ret;
     }
-    printf("after align input amount %ld, block_number %ld",
-           (uint64_t)calculated_capacity, align_target_data.block_number);
+    LOG_TRACE("after align input amount %ld, block_number %ld",
+              (uint64_t)calculated_capacity, align_target_data.block_number);
     if (__builtin_uaddl_overflow(total_input_dckb, calculated_capacity,
                                  &total_input_dckb)) {
       return ERROR_OVERFLOW;
     }
   }
 
+  if (deposit_header_hints.indexes != NULL &&
+      deposit_header_hints.len != (uint32_t)view->input_dckb_cnt) {
+    return ERROR_DCKB_HEADER_HINT;
+  }
+
   uint64_t total_output_dckb = 0;
-  for (int i = 0; i < output_dckb_cells_cnt; i++) {
-    if (__builtin_uaddl_overflow(total_output_dckb, output_dckb_cells[i].amount,
+  for (int i = 0; i < view->output_dckb_cnt; i++) {
+    if (__builtin_uaddl_overflow(total_output_dckb,
+                                 view->output_dckb[i].amount,
                                  &total_output_dckb)) {
       return ERROR_OVERFLOW;
     }
   }
 
-  printf("total input dckb %ld total output dckb %ld", total_input_dckb,
-         total_output_dckb);
+  LOG_DEBUG("total input dckb %ld total output dckb %ld", total_input_dckb,
+            total_output_dckb);
 
-  uint64_t destroy_amount;
   if (__builtin_usubl_overflow(total_input_dckb, total_output_dckb,
-                               &destroy_amount)) {
+                               destroy_amount)) {
     return ERROR_OVERFLOW;
   }
-  printf("destroy amount %ld, expect %ld", destroy_amount,
-         expected_destroy_amount);
-  /* check destroy dckb */
-  if (destroy_amount != expected_destroy_amount) {
+  LOG_DEBUG("destroy amount %ld", *destroy_amount);
+  return CKB_SUCCESS;
+}
+
+/* expected amount of the batch, the NervosDAO inputs of other groups of this
+ * lock in the same withdraw phase as the group
+ * phase1: custodian amount, every cell must custody some DCKB
+ * phase2: destroy amount
+ * batch_cnt is the count of the batch cells
+ */
+int load_batch_expected_amount(header_table_t *header_table,
+                               const TxView *view, int is_phase1,
+                               uint64_t *batch_expected_amount,
+                               int *batch_cnt) {
+  *batch_expected_amount = 0;
+  *batch_cnt = 0;
+  for (int i = 0; i < view->batch_dao_cnt; i++) {
+    const TokenInfo *cell = &view->batch_dao[i];
+    int is_cell_phase1 = cell->block_number != 0;
+    if (is_cell_phase1 != is_phase1) {
+      continue;
+    }
+    uint64_t amount;
+    int ret = check_withdraw_unlock_condition(header_table, cell, 1, NULL,
+                                              &is_cell_phase1, &amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (!is_phase1 && amount == 0) {
+      return ERROR_DL_INCOMPLETE_BATCH;
+    }
+    if (__builtin_uaddl_overflow(*batch_expected_amount, amount,
+                                 batch_expected_amount)) {
+      return ERROR_OVERFLOW;
+    }
+    (*batch_cnt)++;
+  }
+  LOG_DEBUG("batch cells %d, expect %ld", *batch_cnt, *batch_expected_amount);
+  return CKB_SUCCESS;
+}
+
+/* phase1, a batch shares one custodian cell and each of its cells custodies
+ * some DCKB, so phase2 can tell by the amount that a shared custodian is
+ * unlocked with all cells it backs */
+int check_phase1_batch(const TxView *view, const GroupWitness *group_witness) {
+  if (group_witness->custodian_cnt != 1) {
+    return ERROR_DL_INVALID_CUSTODIAN_CELL;
+  }
+  for (int i = 0; i < view->group_dao_cnt; i++) {
+    uint64_t amount;
+    int ret = load_custody_amount(&view->group_dao[i], &amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (amount == 0) {
+      return ERROR_DL_INCOMPLETE_BATCH;
+    }
+  }
+  return CKB_SUCCESS;
+}
+
+/* phase1, DCKB of all custodian outputs of the transaction */
+int load_phase1_custodied_amount(const ScriptContext *context,
+                                 const TxViewConfig *config, TxView *view,
+                                 uint64_t *custodied_amount) {
+  int ret = fetch_outputs(config, view);
+  LOG_DEBUG("fetch outputs ret %d", ret);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  *custodied_amount = 0;
+  for (int i = 0; i < view->output_dckb_cnt; i++) {
+    const TokenInfo *cell = &view->output_dckb[i];
+    uint8_t custodian_args[HASH_SIZE];
+    ret = load_cell_lock_args(context->custodian_lock_code_hash,
+                              cell->cell_index, CKB_SOURCE_OUTPUT,
+                              custodian_args, HASH_SIZE);
+    if (ret == ERROR_INCORRECT_LOCK) {
+      continue;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (__builtin_uaddl_overflow(*custodied_amount, cell->amount,
+                                 custodied_amount)) {
+      return ERROR_OVERFLOW;
+    }
+  }
+  return CKB_SUCCESS;
+}
+
+/* phase1, the custodian cells of the group hold X of the group alone, or
+ * one custodian cell holds X of the group and its batch. Groups with their
+ * own custodian cells are accepted if all custodian outputs of the
+ * transaction hold X of the batch, so no custodian is counted by two groups.
+ * The batch is only summed when the group has other groups. */
+int check_phase1_custodian_amount(const ScriptContext *context,
+                                  const TxViewConfig *config,
+                                  header_table_t *header_table, TxView *view,
+                                  const GroupWitness *group_witness,
+                                  uint128_t custodian_amount,
+                                  uint64_t group_expected_amount) {
+  if (custodian_amount == group_expected_amount && view->batch_dao_cnt == 0) {
+    return CKB_SUCCESS;
+  }
+  uint64_t expected_amount;
+  int batch_cnt;
+  int ret = load_batch_expected_amount(header_table, view, 0, &expected_amount,
+                                       &batch_cnt);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (__builtin_uaddl_overflow(expected_amount, group_expected_amount,
+                               &expected_amount)) {
+    return ERROR_OVERFLOW;
+  }
+  LOG_DEBUG("custodian amount %ld, expect %ld of the group, %ld of the batch",
+            (uint64_t)custodian_amount, group_expected_amount,
+            expected_amount);
+  if (custodian_amount == group_expected_amount) {
+    if (batch_cnt == 0) {
+      return CKB_SUCCESS;
+    }
+    uint64_t custodied_amount;
+    ret = load_phase1_custodied_amount(context, config, view,
+                                       &custodied_amount);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    LOG_DEBUG("custodied amount %ld", custodied_amount);
+    if (custodied_amount != expected_amount) {
+      return ERROR_DL_INCORRECT_DESTROY_AMOUNT;
+    }
+    return CKB_SUCCESS;
+  }
+  if (batch_cnt > 0) {
+    ret = check_phase1_batch(view, group_witness);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+  }
+  if (custodian_amount != expected_amount) {
     return ERROR_DL_INCORRECT_DESTROY_AMOUNT;
   }
+  return CKB_SUCCESS;
+}
 
+/* the lead of the batch in the withdraw phase is the group of its first
+ * NervosDAO input. Every group of a batch runs this script over the same
+ * cells, so a check of the whole batch is done by the lead only */
+int is_batch_lead(const TxView *view, int is_phase1) {
+  for (int i = 0; i < view->batch_dao_cnt; i++) {
+    const TokenInfo *cell = &view->batch_dao[i];
+    int is_cell_phase1 = cell->block_number != 0;
+    if (is_cell_phase1 == is_phase1) {
+      return view->group_dao[0].cell_index < cell->cell_index;
+    }
+  }
+  return 1;
+}
+
+/* phase2, the destroy amount must be the expected amount of the group and
+ * its batch */
+int check_phase2_destroy_amount(header_table_t *header_table,
+                                const TxView *view, uint64_t destroy_amount,
+                                uint64_t group_expected_amount) {
+  uint64_t expected_amount;
+  int batch_cnt;
+  int ret = load_batch_expected_amount(header_table, view, 1, &expected_amount,
+                                       &batch_cnt);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (__builtin_uaddl_overflow(expected_amount, group_expected_amount,
+                               &expected_amount)) {
+    return ERROR_OVERFLOW;
+  }
+  LOG_DEBUG("amount %ld, expect %ld", destroy_amount, expected_amount);
+  if (destroy_amount != expected_amount) {
+    return ERROR_DL_INCORRECT_DESTROY_AMOUNT;
+  }
   return CKB_SUCCESS;
 }
 
 int main() {
-  uint8_t dckb_type_hash[HASH_SIZE];
-  uint8_t refund_lock_hash[HASH_SIZE];
-  int ret = load_dckb_type_hash(dckb_type_hash, refund_lock_hash);
-  printf("load dckb type hash %d", ret);
+  MARK_PHASE("start");
+  /* load self lock hash and args once */
+  ScriptContext context;
+  int ret = load_script_context(&context, NULL, CUSTODIAN_LOCK_CODE_HASH,
+                                DL_ARGS_SIZE);
+  LOG_DEBUG("load script context %d", ret);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  MARK_PHASE("script_load");
+
+  /* header deps are loaded once and shared by all header lookups */
+  header_table_t header_table;
+  init_header_table(&header_table);
+
+  /* scan inputs, outputs are only scanned in phase2 */
+  TxViewConfig config = {0};
+  config.dckb_type_hash = DL_ARGS_DCKB_TYPE_HASH(&context);
+  config.group_lock_hash = context.script_hash;
+  config.refund_lock_hash = DL_ARGS_REFUND_LOCK_HASH(&context);
+  /* other groups are found by the code hash, so only for a data hash type */
+  if (context.hash_type == HASH_TYPE_DATA) {
+    config.batch_dao_lock_code_hash = context.code_hash;
+  }
+  arena_t arena;
+  init_arena(&arena);
+  TxView view;
+  init_tx_view(&view, &arena);
+  ret = fetch_inputs(&config, &view);
+  LOG_DEBUG("fetch inputs ret %d", ret);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  ret = check_group_inputs(&view);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
+  MARK_PHASE("fetch_inputs");
+
+  GroupWitness group_witness;
+  ret = load_group_witness(&view, &group_witness);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  MARK_PHASE("group_witness");
 
   int is_input_cell_phase1;
   uint64_t expected_custodian_amount;
-  ret = check_withdraw_unlock_condition(&is_input_cell_phase1,
-                                        &expected_custodian_amount);
+  ret = check_withdraw_unlock_condition(
+      &header_table, view.group_dao, view.group_dao_cnt,
+      group_witness.header_indexes, &is_input_cell_phase1,
+      &expected_custodian_amount);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
+  MARK_PHASE("unlock_condition");
 
   /* check unlock condition */
   if (!is_input_cell_phase1) {
     /* we are performing DAO withdraw phase1.
      * 1. anyone custodian enough DCKB can unlock DAO cells.
-     * 2. outputs must include a valid custodian cell.
+     * 2. outputs must include valid custodian cells.
      */
-    uint8_t custodian_cell_i = 0;
-    ret = load_custodian_cell_index(&custodian_cell_i);
+    uint128_t custodian_amount;
+    ret = load_phase1_custodian_amount(&context, &view, &group_witness,
+                                       &custodian_amount);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
-    ret = check_phase1_custodian_cell(dckb_type_hash, custodian_cell_i,
-                                      expected_custodian_amount);
+    MARK_PHASE("phase1_custodian_cell");
+    ret = check_phase1_custodian_amount(&context, &config, &header_table,
+                                        &view, &group_witness, custodian_amount,
+                                        expected_custodian_amount);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
@@ -549,27 +847,54 @@ int main() {
      * 1. inputs must include the custodian cell used in phase1 unlock.
      * 2. must destroy expected_custodian_amount DCKB.
      */
-    uint8_t custodian_cell_i = 0;
-    ret = load_custodian_cell_index(&custodian_cell_i);
+    ret = check_phase2_group_witness(&group_witness);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
     /* unlock via custodian cell */
-    ret = check_phase2_custodian_cell(dckb_type_hash, custodian_cell_i);
+    uint64_t custodian_cell_i = group_witness.custodian_indexes[0];
+    uint8_t custodian_cell_tx_hash[HASH_SIZE];
+    ret = check_phase2_custodian_cell(&context, &view, custodian_cell_i,
+                                      custodian_cell_tx_hash);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    ret = check_phase2_custodian_amount(&view, custodian_cell_i,
+                                        custodian_cell_tx_hash);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
+    MARK_PHASE("check_phase2_custodian_cell");
 
-    ret = check_refund_ckb_cell(refund_lock_hash);
+    ret = fetch_outputs(&config, &view);
+    LOG_DEBUG("fetch outputs ret %d", ret);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
-    ret = check_destroy_dckb_amount(dckb_type_hash, expected_custodian_amount);
+    MARK_PHASE("fetch_outputs");
+    ret = check_refund_ckb_cell(&view);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
+    MARK_PHASE("check_refund_ckb_cell");
+    /* the destroy amount is of the whole batch, checked by the lead */
+    if (is_batch_lead(&view, is_input_cell_phase1)) {
+      uint64_t destroy_amount;
+      ret = load_destroy_amount(&header_table, &view, &destroy_amount);
+      if (ret != CKB_SUCCESS) {
+        return ret;
+      }
+      /* input DCKB are aligned unless the amount is committed */
+      MARK_PHASE("alignment");
+      ret = check_phase2_destroy_amount(&header_table, &view, destroy_amount,
+                                        expected_custodian_amount);
+      if (ret != CKB_SUCCESS) {
+        return ret;
+      }
+    }
   }
 
-  printf("DAO unlock success");
+  LOG_DEBUG("DAO unlock success");
+  MARK_PHASE("done");
   return CKB_SUCCESS;
 }
@@ -4,6 +4,9 @@
 
 #include "protocol.h"
 #include "stdio.h"
+#include "trace.h"
+#include "udiv128.h"
+#include "witness.h"
 
 #define ERROR_UNKNOWN -1
 #define ERROR_WRONG_NUMBER_OF_ARGUMENTS -2
@@ -54,7 +57,7 @@ const uint8_t NERVOS_DAO_TYPE_HASH[] = {204, 119, 196, 222, 172, 5,   214, 138,
 
 int is_dao_type(uint8_t type_hash[HASH_SIZE]) {
   int ret = memcmp(NERVOS_DAO_TYPE_HASH, type_hash, HASH_SIZE);
-  printf("ret %i", ret);
+  LOG_TRACE("ret %i", ret);
   return ret == 0;
 }
 
@@ -90,7 +93,8 @@ typedef struct {
   uint64_t epoch_number;
   uint64_t epoch_index;
   uint64_t epoch_length;
-  uint8_t dao[32];
+  /* dao[8..16], the only part of the dao field used by the formula */
+  uint64_t accumulate_rate;
 } dao_header_data_t;
 
 static int extract_epoch_info(uint64_t epoch, int allow_zero_epoch_length,
@@ -121,71 +125,94 @@ static int extract_epoch_info(uint64_t epoch, int allow_zero_epoch_length,
  * can be cleaned as soon as it is not needed.
  */
 static int extract_deposit_header_index(size_t input_index, size_t *index) {
-  int ret;
-  uint64_t len = 0;
-  unsigned char witness[MAX_WITNESS_SIZE];
-
-  len = MAX_WITNESS_SIZE;
-  ret = ckb_load_witness(witness, &len, 0, input_index, CKB_SOURCE_INPUT);
-  if (ret != CKB_SUCCESS) {
-    return ERROR_SYSCALL;
-  }
-  if (len > MAX_WITNESS_SIZE) {
-    return ERROR_WITNESS_TOO_LONG;
-  }
-
-  mol_seg_t witness_seg;
-  witness_seg.ptr = (uint8_t *)witness;
-  witness_seg.size = len;
-
-  if (MolReader_WitnessArgs_verify(&witness_seg, false) != MOL_OK) {
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, input_index, CKB_SOURCE_INPUT);
+  if (ret == ERROR_ENCODING) {
     return ERROR_ENCODING;
   }
-  /* Load type args */
-  mol_seg_t type_seg = MolReader_WitnessArgs_get_input_type(&witness_seg);
-
-  if (MolReader_BytesOpt_is_none(&type_seg)) {
-    return ERROR_ENCODING;
+  if (ret != CKB_SUCCESS) {
+    return ERROR_SYSCALL;
   }
 
-  mol_seg_t type_bytes_seg = MolReader_Bytes_raw_bytes(&type_seg);
-  if (type_bytes_seg.size != 8) {
+  uint8_t type_bytes[8];
+  ret = load_witness_args_field(&witness, WITNESS_ARGS_INPUT_TYPE, type_bytes,
+                                8);
+  if (ret != CKB_SUCCESS) {
     return ERROR_ENCODING;
   }
 
-  *index = *type_bytes_seg.ptr;
+  *index = type_bytes[0];
   return CKB_SUCCESS;
 }
 
+/* Header is a fixed size struct: raw(RawHeader, 192) | nonce(16), and
+ * RawHeader is version(4) | compact_target(4) | timestamp(8) | number(8) |
+ * epoch(8) | parent_hash(32) | transactions_root(32) | proposals_hash(32) |
+ * uncles_hash(32) | dao(32).
+ * Structs need no verification beyond their size, so we only load the bytes
+ * from number to the accumulate rate dao[8..16] with a single syscall.
+ */
+#define HEADER_STRUCT_SIZE 208
+#define HEADER_NUMBER_OFFSET 16
+#define HEADER_EPOCH_OFFSET 24
+#define HEADER_DAO_AR_OFFSET 168
+#define HEADER_PARTIAL_SIZE (HEADER_DAO_AR_OFFSET + 8 - HEADER_NUMBER_OFFSET)
+
 int load_dao_header_data(size_t index, size_t source, dao_header_data_t *data) {
-  uint8_t buffer[HEADER_SIZE];
-  uint64_t len = HEADER_SIZE;
-  int ret = ckb_load_header(buffer, &len, 0, index, source);
+  uint8_t buffer[HEADER_PARTIAL_SIZE];
+  uint64_t len = HEADER_PARTIAL_SIZE;
+  int ret = ckb_load_header(buffer, &len, HEADER_NUMBER_OFFSET, index, source);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  if (len > HEADER_SIZE) {
-    return ERROR_BUFFER_NOT_ENOUGH;
+  /* len is the full size minus offset */
+  if (len != HEADER_STRUCT_SIZE - HEADER_NUMBER_OFFSET) {
+    return ERROR_ENCODING;
   }
 
-  mol_seg_t header_seg;
-  header_seg.ptr = (uint8_t *)buffer;
-  header_seg.size = len;
+  /* buffer starts at number */
+  uint64_t epoch =
+      *((uint64_t *)(buffer + HEADER_EPOCH_OFFSET - HEADER_NUMBER_OFFSET));
+  data->block_number = *((uint64_t *)buffer);
+  data->accumulate_rate =
+      *((uint64_t *)(buffer + HEADER_DAO_AR_OFFSET - HEADER_NUMBER_OFFSET));
+  return extract_epoch_info(epoch, 0, &(data->epoch_number),
+                            &(data->epoch_index), &(data->epoch_length));
+}
 
-  if (MolReader_Header_verify(&header_seg, false) != MOL_OK) {
-    return ERROR_ENCODING;
+/* calculate with the divisor of deposit accumulate rate, cells deposited in
+ * the same block share one divisor */
+int calculate_dao_input_capacity_by_divisor(
+    uint64_t occupied_capacity, const udiv128_divisor_t *deposit_ar_divisor,
+    uint64_t withdraw_accumulate_rate, uint64_t original_capacity,
+    uint64_t *calculated_capacity) {
+  uint64_t counted_capacity = 0;
+  if (__builtin_usubl_overflow(original_capacity, occupied_capacity,
+                               &counted_capacity)) {
+    LOG_ERROR("original_capacity %ld occupied_capacity %ld", original_capacity,
+              occupied_capacity);
+    return ERROR_OVERFLOW;
+  }
+
+  uint64_t withdraw_counted_capacity = 0;
+  int ret = udiv128_mul_div(counted_capacity, withdraw_accumulate_rate,
+                            deposit_ar_divisor, &withdraw_counted_capacity);
+  if (ret != CKB_SUCCESS) {
+    LOG_ERROR("counted_capacity %ld withdraw_accumulate_rate %ld",
+              counted_capacity, withdraw_accumulate_rate);
+    return ERROR_OVERFLOW;
   }
 
-  mol_seg_t raw_seg = MolReader_Header_get_raw(&header_seg);
-  mol_seg_t dao_seg = MolReader_RawHeader_get_dao(&raw_seg);
-  mol_seg_t epoch_seg = MolReader_RawHeader_get_epoch(&raw_seg);
-  mol_seg_t block_number_seg = MolReader_RawHeader_get_number(&raw_seg);
+  uint64_t withdraw_capacity = 0;
+  if (__builtin_uaddl_overflow(occupied_capacity, withdraw_counted_capacity,
+                               &withdraw_capacity)) {
+    LOG_ERROR("original_capacity %ld occupied_capacity %ld", original_capacity,
+              withdraw_counted_capacity);
+    return ERROR_OVERFLOW;
+  }
 
-  data->block_number = *((uint64_t *)block_number_seg.ptr);
-  memcpy(data->dao, dao_seg.ptr, 32);
-  return extract_epoch_info(*((uint64_t *)epoch_seg.ptr), 0,
-                            &(data->epoch_number), &(data->epoch_index),
-                            &(data->epoch_length));
+  *calculated_capacity = withdraw_capacity;
+  return CKB_SUCCESS;
 }
 
 int calculate_dao_input_capacity(uint64_t occupied_capacity,
@@ -199,30 +226,13 @@ int calculate_dao_input_capacity(uint64_t occupied_capacity,
     return ERROR_INVALID_WITHDRAW_BLOCK;
   }
 
-  uint64_t deposit_accumulate_rate = *((uint64_t *)(&deposit_data.dao[8]));
-  uint64_t withdraw_accumulate_rate =
-      *((uint64_t *)(&align_target_data.dao[8]));
-  uint64_t counted_capacity = 0;
-  if (__builtin_usubl_overflow(original_capacity, occupied_capacity,
-                               &counted_capacity)) {
-    printf("original_capacity %ld occupied_capacity %ld", original_capacity,
-           occupied_capacity);
-    return ERROR_OVERFLOW;
-  }
-
-  __int128 withdraw_counted_capacity = ((__int128)counted_capacity) *
-                                       ((__int128)withdraw_accumulate_rate) /
-                                       ((__int128)deposit_accumulate_rate);
-
-  uint64_t withdraw_capacity = 0;
-  if (__builtin_uaddl_overflow(occupied_capacity,
-                               (uint64_t)withdraw_counted_capacity,
-                               &withdraw_capacity)) {
-    printf("original_capacity %ld occupied_capacity %ld", original_capacity,
-           (uint64_t)withdraw_counted_capacity);
-    return ERROR_OVERFLOW;
+  udiv128_divisor_t deposit_ar_divisor;
+  int ret =
+      init_udiv128_divisor(deposit_data.accumulate_rate, &deposit_ar_divisor);
+  if (ret != CKB_SUCCESS) {
+    return ret;
   }
-
-  *calculated_capacity = withdraw_capacity;
-  return CKB_SUCCESS;
+  return calculate_dao_input_capacity_by_divisor(
+      occupied_capacity, &deposit_ar_divisor, align_target_data.accumulate_rate,
+      original_capacity, calculated_capacity);
 }
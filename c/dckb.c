@@ -4,10 +4,16 @@
  * DCKB owner can withdraw native CKB and interests from NervosDAO by destroy
  * corresponded DCKB.
  *
- * DCKB format:
- * data: tokens(16 bytes) | height(8 bytes)
- * > 16 bytes u128 number to store the TOKEN.
+ * DCKB format, told apart by the data length:
+ * data: tokens(16 bytes) | height(8 bytes), 24 bytes
+ * > 16 bytes u128 number to store the TOKEN, the sUDT amount layout.
  * > 8 bytes u64 number to store the block number.
+ * data: version(1 byte) | tokens(8 bytes) | height(8 bytes), 17 bytes
+ * > version is 1 (DCKB_COMPACT_DATA_VERSION), other versions are rejected.
+ * > 8 bytes u64 number to store the TOKEN.
+ * > 8 bytes u64 number to store the block number.
+ * Data of any other length fails with ERROR_LOAD_DCKB_DATA. Both layouts are
+ * accepted in inputs and outputs, and may be mixed in a transaction.
  *
  * Align block:
  * 1. In a transaction, all inputs and outputs DCKB cells should aligned to a
@@ -16,6 +22,10 @@
  * and update the amount by apply NervosDAO formula.
  * 3. The first input DCKB cell should has a u64 value in the witness args's
  * input_type the value represents the align target block number.
+ * 4. Optional, the input_type can be followed by a u8 header deps index of the
+ * align target, and a u8 header deps index of the deposit header for each
+ * input DCKB in order (any value for a new DCKB). The script then checks
+ * the indexed headers instead of searching header deps by block number.
  *
  * Verification:
  * This type script make sure the equation between inputs and outputs(all coins
@@ -23,6 +33,10 @@
  * 1. inputs DCKB >= outputs DCKB
  * 2. new DCKB == deposited NervosDAO
  * 3. all outputs DCKB's block number must align to align target block number
+ * 4. if the witness of the first output DCKB has a u64 output_type, it equals
+ * to the destroyed DCKB: inputs DCKB - outputs DCKB, new DCKB excluded.
+ * dao_lock reads this amount in withdraw phase2 instead of aligning the inputs
+ * again.
  *
  * Get DCKB:
  * 1. send a NervosDAO deposition request
@@ -41,150 +55,125 @@
  * coins.
  * 3. Put a withdrawed output.
  *
+ * Rounding:
+ * Each input DCKB cell is aligned and rounded down on its own. A script built
+ * with DCKB_ALIGN_SUM_BY_HEIGHT=1 sums the inputs of the same height and
+ * rounds the sum once, this issues slightly more DCKB, so it is a new DCKB
+ * version (a different type hash) instead of a drop-in replacement.
+ *
  */
 
-#include "blake2b.h"
 #include "ckb_syscalls.h"
 #include "common.h"
 #include "dao_lock.h"
 #include "protocol.h"
 #include "stdio.h"
+#include "trace.h"
+
+#ifndef DCKB_ALIGN_SUM_BY_HEIGHT
+#define DCKB_ALIGN_SUM_BY_HEIGHT 0
+#endif
 
 int main() {
-  printf("hello");
+  LOG_DEBUG("hello");
+  MARK_PHASE("start");
   int ret;
-  uint8_t type_hash[HASH_SIZE];
-  uint64_t len = HASH_SIZE;
-  /* load self type hash */
-  ret = ckb_load_script_hash(type_hash, &len, 0);
-  printf("load self script ret %d", ret);
-  if (ret != CKB_SUCCESS || len != HASH_SIZE) {
-    return ERROR_SYSCALL;
+  /* Checks are ordered by cost, so an invalid transaction is rejected before
+   * any header is loaded or any input is aligned:
+   * 1. script and witnesses, the align target is only parsed
+   * 2. outputs, output DCKB must be aligned to the target block number
+   * 3. equation 2, it only needs outputs
+   * 4. inputs are aligned to the target header, equation 1 and 3 */
+
+  /* load self type hash, DCKB has no args */
+  ScriptContext context;
+  ret = load_script_context(&context, DAO_LOCK_CODE_HASH, NULL, 0);
+  LOG_DEBUG("load self script ret %d", ret);
+  if (ret != CKB_SUCCESS) {
+    return ret;
   }
-  /* load aligned target header */
-  dao_header_data_t align_target_data;
-  ret = load_align_target_dao_header_data(0, CKB_SOURCE_GROUP_INPUT,
-                                          &align_target_data);
-  printf("load aligned target ret %d", ret);
+  arena_t arena;
+  init_arena(&arena);
+  AlignTarget align_target;
+  ret = load_align_target(&arena, 0, CKB_SOURCE_GROUP_INPUT, &align_target);
+  LOG_DEBUG("load aligned target ret %d", ret);
   if (ret != CKB_SUCCESS && ret != ERROR_LOAD_DAO_HEADER_DATA) {
     return ret;
   }
   /* only transfer DCKB need align target data, we lazy raise this error */
   int has_aligned_target = ret == CKB_SUCCESS;
-
-  /* fetch inputs */
-  TokenInfo input_dckb_cells[MAX_SWAP_CELLS];
-  int input_dckb_cells_cnt;
-  ret = fetch_inputs(type_hash, DAO_LOCK_CODE_HASH, NULL, NULL, NULL, NULL,
-                     &input_dckb_cells_cnt, input_dckb_cells);
-  printf("fetch inputs ret %d", ret);
+  int has_destroy_amount;
+  uint64_t destroy_amount;
+  ret = load_committed_destroy_amount(0, CKB_SOURCE_GROUP_OUTPUT,
+                                      &has_destroy_amount, &destroy_amount);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  /* fetch outputs */
-  int deposited_dao_cells_cnt = 0;
-  SwapInfo deposited_dao_cells[MAX_SWAP_CELLS];
-  int output_new_dckb_cells_cnt = 0;
-  SwapInfo output_new_dckb_cells[MAX_SWAP_CELLS];
-  int output_dckb_cells_cnt = 0;
-  TokenInfo output_dckb_cells[MAX_SWAP_CELLS];
-  ret = fetch_outputs(type_hash, DAO_LOCK_CODE_HASH, &deposited_dao_cells_cnt,
-                      deposited_dao_cells, &output_new_dckb_cells_cnt,
-                      output_new_dckb_cells, &output_dckb_cells_cnt,
-                      output_dckb_cells);
-  printf("fetch outputs ret %d", ret);
+  MARK_PHASE("script_load");
+
+  /* scan outputs, DCKB are summed during the scan */
+  TxViewConfig config = {0};
+  config.dckb_type_hash = context.script_hash;
+  config.dao_lock_code_hash = context.dao_lock_code_hash;
+  config.accumulate = 1;
+  config.sum_by_height = DCKB_ALIGN_SUM_BY_HEIGHT;
+  config.align_target_number =
+      has_aligned_target ? &align_target.block_number : NULL;
+  TxView view;
+  init_tx_view(&view, &arena);
+  ret = fetch_outputs(&config, &view);
+  LOG_DEBUG("fetch outputs ret %d", ret);
   if (ret != CKB_SUCCESS) {
     return ret;
   }
-  printf("deposited_dao_cells_cnt %d output_uninit_cnt %d output_init_cnt %d",
-         deposited_dao_cells_cnt, output_new_dckb_cells_cnt,
-         output_dckb_cells_cnt);
-  /* check equations
-   * 1. inputs DCKB >= outputs DCKB
-   * 2. new DCKB == deposited NervosDAO
-   */
-  if (input_dckb_cells_cnt > 0 && !has_aligned_target) {
-    return ERROR_LOAD_ALIGN_TARGET;
+  MARK_PHASE("fetch_outputs");
+  /* equation 2. new DCKB == deposited NervosDAO */
+  if (view.total_output_new_dckb != view.total_deposited_dao) {
+    LOG_DEBUG("new dckb amount %ld, deposited_dao amount %ld",
+              view.total_output_new_dckb, view.total_deposited_dao);
+    return ERROR_DCKB_INCORRECT_OUTPUT_UNINIT_TOKEN;
   }
-  uint64_t calculated_capacity;
-  uint64_t total_input_dckb = 0;
-  for (int i = 0; i < input_dckb_cells_cnt; i++) {
-    printf("input amount %ld, block_number %ld",
-           (uint64_t)input_dckb_cells[i].amount,
-           input_dckb_cells[i].block_number);
-    ret = align_dckb_cell(input_dckb_cells[i].cell_index, CKB_SOURCE_INPUT,
-                          align_target_data, input_dckb_cells[i].block_number,
-                          input_dckb_cells[i].amount, &calculated_capacity);
+
+  /* scan inputs, DCKB are aligned and summed during the scan, header deps
+   * are loaded once and shared by all header lookups */
+  header_table_t header_table;
+  init_header_table(&header_table);
+  dao_header_data_t align_target_data;
+  if (has_aligned_target) {
+    ret = load_align_target_header(&header_table, &align_target,
+                                   &align_target_data);
     if (ret != CKB_SUCCESS) {
       return ret;
     }
-    printf("after align input amount %ld, block_number %ld",
-           (uint64_t)calculated_capacity, align_target_data.block_number);
-    if (__builtin_uaddl_overflow(total_input_dckb, calculated_capacity,
-                                 &total_input_dckb)) {
-      return ERROR_OVERFLOW;
-    }
-  }
-
-  if (output_dckb_cells_cnt > 0 && !has_aligned_target) {
-    return ERROR_LOAD_ALIGN_TARGET;
+    config.align_target = &align_target_data;
+    config.deposit_header_hints = align_target.hints;
   }
-  uint64_t total_output_dckb = 0;
-  for (int i = 0; i < output_dckb_cells_cnt; i++) {
-    if (output_dckb_cells[i].block_number != align_target_data.block_number) {
-      printf("output align to %ld, expected %ld",
-             output_dckb_cells[i].block_number, align_target_data.block_number);
-      return ERROR_DCKB_OUTPUT_ALIGN;
-    }
-    if (__builtin_uaddl_overflow(total_output_dckb, output_dckb_cells[i].amount,
-                                 &total_output_dckb)) {
-      return ERROR_OVERFLOW;
-    }
+  MARK_PHASE("align_target");
+  config.header_table = &header_table;
+  ret = fetch_inputs(&config, &view);
+  LOG_DEBUG("fetch inputs ret %d", ret);
+  if (ret != CKB_SUCCESS) {
+    return ret;
   }
-
-  /* 1. inputs DCKB >= outputs DCKB */
-  if (total_input_dckb < total_output_dckb) {
-    printf(
+  /* input DCKB are aligned during the scan */
+  MARK_PHASE("fetch_inputs");
+  /* equation 1. inputs DCKB >= outputs DCKB */
+  if (view.total_input_dckb < view.total_output_dckb) {
+    LOG_DEBUG(
         "equation 1 total_input_dckb %ld "
         "total_output_dckb %ld",
-        total_input_dckb, total_output_dckb);
+        view.total_input_dckb, view.total_output_dckb);
     return ERROR_DCKB_INCORRECT_OUTPUT;
   }
-
-  /* 2. new DCKB == deposited NervosDAO */
-  uint64_t total_output_new_dckb = 0;
-  for (int i = 0; i < output_new_dckb_cells_cnt; i++) {
-    uint64_t amount = (uint64_t)output_new_dckb_cells[i].amount;
-    if (amount != output_new_dckb_cells[i].amount) {
-      return ERROR_OVERFLOW;
-    }
-    if (__builtin_uaddl_overflow(total_output_new_dckb, amount,
-                                 &total_output_new_dckb)) {
-      return ERROR_OVERFLOW;
-    }
-  }
-
-  uint64_t total_deposited_dao = 0;
-  for (int i = 0; i < deposited_dao_cells_cnt; i++) {
-    uint64_t amount = (uint64_t)deposited_dao_cells[i].amount;
-    if (amount != deposited_dao_cells[i].amount) {
-      return ERROR_OVERFLOW;
-      /* remove DAO cell occupied capacity */
-    }
-    if (__builtin_usubl_overflow(amount, DAO_OCCUPIED_CAPACITY, &amount)) {
-      return ERROR_OVERFLOW;
-    }
-    if (__builtin_uaddl_overflow(total_deposited_dao, amount,
-                                 &total_deposited_dao)) {
-      return ERROR_OVERFLOW;
-    }
-  }
-  if (total_output_new_dckb != total_deposited_dao) {
-    printf("new dckb amount %ld, deposited_dao amount %ld",
-           (uint64_t)total_output_new_dckb, (uint64_t)total_deposited_dao);
-    return ERROR_DCKB_INCORRECT_OUTPUT_UNINIT_TOKEN;
+  /* equation 3. committed destroy amount == inputs DCKB - outputs DCKB */
+  if (has_destroy_amount &&
+      destroy_amount != view.total_input_dckb - view.total_output_dckb) {
+    LOG_DEBUG("committed destroy amount %ld, actual %ld", destroy_amount,
+              view.total_input_dckb - view.total_output_dckb);
+    return ERROR_DCKB_DESTROY_AMOUNT;
   }
 
-  printf("done");
+  LOG_DEBUG("done");
+  MARK_PHASE("done");
   return CKB_SUCCESS;
 }
@@ -0,0 +1,190 @@
+/*
+header_table.h
+
+A per-script-run table of the transaction's header deps.
+
+Each header dep is loaded and verified once, then kept as a compact
+dao_header_data_t. Lookups by header dep index are O(1), lookups by block
+number are a binary search over an index sorted by block number.
+
+The divisor of a header's accumulate rate is prepared on the first alignment
+against it and reused by the later cells deposited in the same block.
+
+Cells of a transfer usually share a few deposit heights, so lookups by
+deposit height go through a small direct mapped cache of recently used
+heights before the binary search.
+
+Header deps are loaded lazily in header deps order, only as far as a lookup
+needs, like the linear search did. Scripts that never touch header deps (e.g.
+DAO withdraw phase1) pay nothing, and header deps after the searched ones are
+never loaded, so they may be unused or not DAO related. A lookup which has to
+go past the first MAX_HEADER_DEPS header deps fails with
+ERROR_TOO_MANY_HEADER_DEPS.
+*/
+
+#ifndef DCKB_HEADER_TABLE_H
+#define DCKB_HEADER_TABLE_H
+
+#define MAX_HEADER_DEPS 256
+/* slots of the deposit height cache, a power of two */
+#define HEADER_CACHE_SIZE 16
+
+typedef struct {
+  /* all header deps are loaded */
+  int complete;
+  /* number of header deps loaded so far */
+  size_t len;
+  /* headers in header deps order */
+  dao_header_data_t headers[MAX_HEADER_DEPS];
+  /* indexes of loaded headers, sorted by block number, equal numbers keep the
+   * header deps order */
+  uint16_t sorted[MAX_HEADER_DEPS];
+  /* divisors of accumulate rates, in header deps order */
+  udiv128_divisor_t divisors[MAX_HEADER_DEPS];
+  uint8_t has_divisor[MAX_HEADER_DEPS];
+  /* recently used deposit heights, slot by block number, -1 means empty */
+  uint64_t cache_numbers[HEADER_CACHE_SIZE];
+  int16_t cache_indexes[HEADER_CACHE_SIZE];
+} header_table_t;
+
+void init_header_table(header_table_t *table) {
+  table->complete = 0;
+  table->len = 0;
+  for (size_t i = 0; i < HEADER_CACHE_SIZE; i++) {
+    table->cache_indexes[i] = -1;
+  }
+}
+
+/* load the next header dep into the table, return CKB_INDEX_OUT_OF_BOUND when
+ * all header deps are loaded */
+int header_table_load_next(header_table_t *table) {
+  if (table->complete) {
+    return CKB_INDEX_OUT_OF_BOUND;
+  }
+  size_t i = table->len;
+  dao_header_data_t header;
+  int ret = load_dao_header_data(i, CKB_SOURCE_HEADER_DEP, &header);
+  if (ret == CKB_INDEX_OUT_OF_BOUND) {
+    table->complete = 1;
+    return ret;
+  }
+  if (ret != CKB_SUCCESS) {
+    return ERROR_LOAD_HEADER;
+  }
+  if (i >= MAX_HEADER_DEPS) {
+    return ERROR_TOO_MANY_HEADER_DEPS;
+  }
+  table->headers[i] = header;
+  table->has_divisor[i] = 0;
+  /* insertion sort, header deps are few and mostly ordered */
+  size_t j = i;
+  while (j > 0 &&
+         table->headers[table->sorted[j - 1]].block_number >
+             header.block_number) {
+    table->sorted[j] = table->sorted[j - 1];
+    j--;
+  }
+  table->sorted[j] = i;
+  table->len = i + 1;
+  return CKB_SUCCESS;
+}
+
+/* get header by header dep index */
+int header_table_get(header_table_t *table, size_t index,
+                     dao_header_data_t *dao_header_data) {
+  while (index >= table->len) {
+    int ret = header_table_load_next(table);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
+      return ERROR_LOAD_HEADER;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+  }
+  *dao_header_data = table->headers[index];
+  return CKB_SUCCESS;
+}
+
+/* search header by block number, return the index of first matched header
+ * dep. The loaded headers are searched first, then header deps are loaded
+ * until one matches */
+int header_table_search_index(header_table_t *table,
+                              uint64_t expected_block_number, size_t *index) {
+  size_t lo = 0;
+  size_t hi = table->len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (table->headers[table->sorted[mid]].block_number <
+        expected_block_number) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < table->len &&
+      table->headers[table->sorted[lo]].block_number == expected_block_number) {
+    *index = table->sorted[lo];
+    return CKB_SUCCESS;
+  }
+  while (1) {
+    int ret = header_table_load_next(table);
+    if (ret == CKB_INDEX_OUT_OF_BOUND) {
+      return ERROR_LOAD_HEADER;
+    }
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    if (table->headers[table->len - 1].block_number == expected_block_number) {
+      *index = table->len - 1;
+      return CKB_SUCCESS;
+    }
+  }
+}
+
+/* search header by block number, return the first matched header dep */
+int header_table_search(header_table_t *table, uint64_t expected_block_number,
+                        dao_header_data_t *dao_header_data) {
+  size_t index;
+  int ret = header_table_search_index(table, expected_block_number, &index);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  *dao_header_data = table->headers[index];
+  return CKB_SUCCESS;
+}
+
+/* lookup header dep index by deposit height, served from the cache when the
+ * height is used recently */
+int header_table_lookup(header_table_t *table, uint64_t block_number,
+                        size_t *index) {
+  size_t slot = block_number & (HEADER_CACHE_SIZE - 1);
+  if (table->cache_indexes[slot] >= 0 &&
+      table->cache_numbers[slot] == block_number) {
+    *index = table->cache_indexes[slot];
+    return CKB_SUCCESS;
+  }
+  int ret = header_table_search_index(table, block_number, index);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  table->cache_numbers[slot] = block_number;
+  table->cache_indexes[slot] = *index;
+  return CKB_SUCCESS;
+}
+
+/* divisor of the header accumulate rate, index must be a loaded header */
+int header_table_divisor(header_table_t *table, size_t index,
+                         const udiv128_divisor_t **divisor) {
+  if (!table->has_divisor[index]) {
+    int ret = init_udiv128_divisor(table->headers[index].accumulate_rate,
+                                   &table->divisors[index]);
+    if (ret != CKB_SUCCESS) {
+      return ret;
+    }
+    table->has_divisor[index] = 1;
+  }
+  *divisor = &table->divisors[index];
+  return CKB_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*
+native/ckb_syscalls.h
+
+CKB syscalls for the native build of the scripts, see src/native.rs.
+
+The scripts are compiled for the host with this header forced in front
+(-include). It takes the include guard of ckb-c-stdlib's ckb_syscalls.h, so
+the RISC-V version is never pulled in. Each load syscall calls back into the
+host, which serves the transaction of the script group and applies offset and
+length as the VM does: at most *len bytes are copied and *len is set to the
+size of the item from offset.
+
+The callback, its context and the arena region (arena.h) are thread local, so
+scripts can run on several threads at once.
+*/
+
+#ifndef DCKB_NATIVE_CKB_SYSCALLS_H
+#define DCKB_NATIVE_CKB_SYSCALLS_H
+#define CKB_C_STDLIB_CKB_SYSCALLS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ckb_consts.h"
+
+/* each thread running a script has its own arena region */
+#define ARENA_STORAGE static _Thread_local
+
+/* syscall numbers, as in ckb-script */
+#define CKB_NATIVE_LOAD_TRANSACTION 2051
+#define CKB_NATIVE_LOAD_SCRIPT 2052
+#define CKB_NATIVE_LOAD_TX_HASH 2061
+#define CKB_NATIVE_LOAD_SCRIPT_HASH 2062
+#define CKB_NATIVE_LOAD_CELL 2071
+#define CKB_NATIVE_LOAD_HEADER 2072
+#define CKB_NATIVE_LOAD_INPUT 2073
+#define CKB_NATIVE_LOAD_WITNESS 2074
+#define CKB_NATIVE_LOAD_CELL_BY_FIELD 2081
+#define CKB_NATIVE_LOAD_HEADER_BY_FIELD 2082
+#define CKB_NATIVE_LOAD_INPUT_BY_FIELD 2083
+#define CKB_NATIVE_LOAD_CELL_DATA 2092
+
+/* load callback of the host, arguments not taken by a syscall are 0 */
+typedef int (*ckb_native_load_fn)(void *ctx, uint64_t syscall, void *addr,
+                                  uint64_t *len, size_t offset, size_t index,
+                                  size_t source, size_t field);
+
+/* set by the native entry of a script before calling its main */
+_Thread_local ckb_native_load_fn ckb_native_load;
+_Thread_local void *ckb_native_ctx;
+
+int ckb_native_syscall(uint64_t syscall, void *addr, uint64_t *len,
+                       size_t offset, size_t index, size_t source,
+                       size_t field) {
+  return ckb_native_load(ckb_native_ctx, syscall, addr, len, offset, index,
+                         source, field);
+}
+
+int ckb_load_transaction(void *addr, uint64_t *len, size_t offset) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_TRANSACTION, addr, len, offset, 0,
+                            0, 0);
+}
+
+int ckb_load_script(void *addr, uint64_t *len, size_t offset) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_SCRIPT, addr, len, offset, 0, 0,
+                            0);
+}
+
+int ckb_load_tx_hash(void *addr, uint64_t *len, size_t offset) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_TX_HASH, addr, len, offset, 0, 0,
+                            0);
+}
+
+int ckb_load_script_hash(void *addr, uint64_t *len, size_t offset) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_SCRIPT_HASH, addr, len, offset, 0,
+                            0, 0);
+}
+
+int ckb_load_cell(void *addr, uint64_t *len, size_t offset, size_t index,
+                  size_t source) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_CELL, addr, len, offset, index,
+                            source, 0);
+}
+
+int ckb_load_header(void *addr, uint64_t *len, size_t offset, size_t index,
+                    size_t source) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_HEADER, addr, len, offset, index,
+                            source, 0);
+}
+
+int ckb_load_input(void *addr, uint64_t *len, size_t offset, size_t index,
+                   size_t source) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_INPUT, addr, len, offset, index,
+                            source, 0);
+}
+
+int ckb_load_witness(void *addr, uint64_t *len, size_t offset, size_t index,
+                     size_t source) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_WITNESS, addr, len, offset, index,
+                            source, 0);
+}
+
+int ckb_load_cell_by_field(void *addr, uint64_t *len, size_t offset,
+                           size_t index, size_t source, size_t field) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_CELL_BY_FIELD, addr, len, offset,
+                            index, source, field);
+}
+
+int ckb_load_header_by_field(void *addr, uint64_t *len, size_t offset,
+                             size_t index, size_t source, size_t field) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_HEADER_BY_FIELD, addr, len, offset,
+                            index, source, field);
+}
+
+int ckb_load_input_by_field(void *addr, uint64_t *len, size_t offset,
+                            size_t index, size_t source, size_t field) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_INPUT_BY_FIELD, addr, len, offset,
+                            index, source, field);
+}
+
+int ckb_load_cell_data(void *addr, uint64_t *len, size_t offset, size_t index,
+                       size_t source) {
+  return ckb_native_syscall(CKB_NATIVE_LOAD_CELL_DATA, addr, len, offset,
+                            index, source, 0);
+}
+
+int ckb_debug(const char *s) {
+  fprintf(stderr, "%s\n", s);
+  return CKB_SUCCESS;
+}
+
+/* the checked loads fail if the item does not fit in *len */
+
+int ckb_checked_load_script(void *addr, uint64_t *len, size_t offset) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_script(addr, len, offset);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_cell(void *addr, uint64_t *len, size_t offset,
+                          size_t index, size_t source) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_cell(addr, len, offset, index, source);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_header(void *addr, uint64_t *len, size_t offset,
+                            size_t index, size_t source) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_header(addr, len, offset, index, source);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_input(void *addr, uint64_t *len, size_t offset,
+                           size_t index, size_t source) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_input(addr, len, offset, index, source);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_witness(void *addr, uint64_t *len, size_t offset,
+                             size_t index, size_t source) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_witness(addr, len, offset, index, source);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_cell_by_field(void *addr, uint64_t *len, size_t offset,
+                                   size_t index, size_t source, size_t field) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_cell_by_field(addr, len, offset, index, source, field);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_input_by_field(void *addr, uint64_t *len, size_t offset,
+                                    size_t index, size_t source,
+                                    size_t field) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_input_by_field(addr, len, offset, index, source, field);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+int ckb_checked_load_cell_data(void *addr, uint64_t *len, size_t offset,
+                               size_t index, size_t source) {
+  uint64_t old_len = *len;
+  int ret = ckb_load_cell_data(addr, len, offset, index, source);
+  if (ret == CKB_SUCCESS && (*len) > old_len) {
+    ret = CKB_LENGTH_NOT_ENOUGH;
+  }
+  return ret;
+}
+
+#endif
@@ -0,0 +1,11 @@
+/* native entry of the custodian lock, see native/ckb_syscalls.h */
+
+#define main custodian_lock_script_main
+#include "custodian_lock.c"
+#undef main
+
+int custodian_lock_native_main(ckb_native_load_fn load, void *ctx) {
+  ckb_native_load = load;
+  ckb_native_ctx = ctx;
+  return custodian_lock_script_main();
+}
@@ -0,0 +1,11 @@
+/* native entry of the DAO lock, see native/ckb_syscalls.h */
+
+#define main dao_lock_script_main
+#include "dao_lock.c"
+#undef main
+
+int dao_lock_native_main(ckb_native_load_fn load, void *ctx) {
+  ckb_native_load = load;
+  ckb_native_ctx = ctx;
+  return dao_lock_script_main();
+}
@@ -0,0 +1,11 @@
+/* native entry of the DCKB type script, see native/ckb_syscalls.h */
+
+#define main dckb_script_main
+#include "dckb.c"
+#undef main
+
+int dckb_native_main(ckb_native_load_fn load, void *ctx) {
+  ckb_native_load = load;
+  ckb_native_ctx = ctx;
+  return dckb_script_main();
+}
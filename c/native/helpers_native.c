@@ -0,0 +1,73 @@
+/* native entries of the shared helpers, for the property tests of
+ * src/tests/native.rs. The fixed layout readers are checked against the
+ * molecule reader, see native/ckb_syscalls.h */
+
+#include "common.h"
+
+/* floor(a * b / d) by a udiv128_divisor_t of d */
+int helpers_native_udiv128_mul_div(uint64_t a, uint64_t b, uint64_t d,
+                                   uint64_t *quotient) {
+  udiv128_divisor_t divisor;
+  int ret = init_udiv128_divisor(d, &divisor);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  return udiv128_mul_div(a, b, &divisor, quotient);
+}
+
+/* copy a field of the WitnessArgs of input 0 to out, which holds *len bytes,
+ * and set *len to its size. Returns 1 if the field is none */
+int helpers_native_witness_args_field(ckb_native_load_fn load, void *ctx,
+                                      int field, uint8_t *out,
+                                      uint32_t *len) {
+  ckb_native_load = load;
+  ckb_native_ctx = ctx;
+  witness_args_t witness;
+  int ret = load_witness_args(&witness, 0, CKB_SOURCE_INPUT);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (!witness.field_has[field]) {
+    return 1;
+  }
+  uint32_t size = witness.field_size[field];
+  if (size > *len) {
+    return ERROR_ENCODING;
+  }
+  *len = size;
+  return load_witness_args_field(&witness, field, out, size);
+}
+
+/* the same field by the molecule reader over the whole witness */
+int helpers_native_mol_witness_args_field(const uint8_t *witness,
+                                          uint32_t witness_len, int field,
+                                          uint8_t *out, uint32_t *len) {
+  mol_seg_t seg = {(uint8_t *)witness, witness_len};
+  if (MolReader_WitnessArgs_verify(&seg, false) != MOL_OK) {
+    return ERROR_ENCODING;
+  }
+  mol_seg_t field_seg = mol_table_slice_by_index(&seg, field);
+  if (MolReader_BytesOpt_is_none(&field_seg)) {
+    return 1;
+  }
+  mol_seg_t raw = MolReader_Bytes_raw_bytes(&field_seg);
+  if (raw.size > *len) {
+    return ERROR_ENCODING;
+  }
+  memcpy(out, raw.ptr, raw.size);
+  *len = raw.size;
+  return CKB_SUCCESS;
+}
+
+int helpers_native_verify_script_layout(const uint8_t *script, uint64_t len,
+                                        uint64_t args_len) {
+  return verify_script_layout(script, len, args_len);
+}
+
+int helpers_native_mol_verify_script(const uint8_t *script, uint32_t len) {
+  mol_seg_t seg = {(uint8_t *)script, len};
+  if (MolReader_Script_verify(&seg, false) != MOL_OK) {
+    return ERROR_ENCODING;
+  }
+  return CKB_SUCCESS;
+}
@@ -0,0 +1,31 @@
+/*
+phase.h
+
+Phase markers of the instrumentation build, `make PHASES=1`.
+
+A marker prints "phase <name>" by ckb_debug when a script reaches the end of
+a phase. The tests collect the markers from the debug output of their single
+verification run, see verify_tx in src/tests/mod.rs. The VM of this CKB
+version has no syscall to read the current cycles, so the cycles of a marker
+are found by verifying its script group alone under lower cycles limits, the
+marker is printed only if the limit covers the cycles up to it, see
+phase_cycles.
+
+Markers are compiled out unless DCKB_PHASES=1.
+*/
+
+#ifndef DCKB_PHASE_H
+#define DCKB_PHASE_H
+
+#ifndef DCKB_PHASES
+#define DCKB_PHASES 0
+#endif
+
+#define MARK_PHASE(name)        \
+  do {                          \
+    if (DCKB_PHASES) {          \
+      ckb_debug("phase " name); \
+    }                           \
+  } while (0)
+
+#endif
@@ -0,0 +1,43 @@
+/*
+trace.h
+
+Compile-time leveled logging.
+
+Logs at a level above TRACE_LEVEL are compiled out, arguments are still type
+checked but no formatting code or string is left in the binary.
+
+Levels:
+  0 none, production build
+  1 error, reasons of a failure
+  2 debug, results of each check
+  3 trace, per cell details
+
+Set the level with -DTRACE_LEVEL=<level>, `make TRACE_LEVEL=<level>`.
+*/
+
+#ifndef DCKB_TRACE_H
+#define DCKB_TRACE_H
+
+#include "stdio.h"
+
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_DEBUG 2
+#define TRACE_LEVEL_TRACE 3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_NONE
+#endif
+
+#define LOG_AT(level, ...)      \
+  do {                          \
+    if (TRACE_LEVEL >= level) { \
+      printf(__VA_ARGS__);      \
+    }                           \
+  } while (0)
+
+#define LOG_ERROR(...) LOG_AT(TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(TRACE_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(TRACE_LEVEL_TRACE, __VA_ARGS__)
+
+#endif
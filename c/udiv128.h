@@ -0,0 +1,109 @@
+/*
+udiv128.h
+
+Unsigned 128 / 64 division for the DAO interest formula
+capacity * withdraw_ar / deposit_ar.
+
+The product of two u64 takes 128 bits, but the divisor and the quotient fit in
+u64. GCC lowers a 128 bit division to a libgcc routine, which is slow on RV64.
+Here the divisor is normalized once and its reciprocal is computed with a
+Knuth D step. After that, each division by it is one 128 bit multiply (mul
+and mulhu) plus a few corrections, see Moller and Granlund, "Improved
+division by invariant integers".
+
+Divisions by the same divisor should reuse one udiv128_divisor_t, e.g. the
+accumulate rate of a deposit header shared by many cells.
+*/
+
+#ifndef DCKB_UDIV128_H
+#define DCKB_UDIV128_H
+
+typedef struct {
+  /* divisor shifted left until the highest bit is set */
+  uint64_t d;
+  /* reciprocal, floor((2^128 - 1) / d) - 2^64 */
+  uint64_t v;
+  /* shift applied to the divisor */
+  int shift;
+} udiv128_divisor_t;
+
+/* Knuth D with 32 bit digits, (hi, lo) / d,
+ * requires d to be normalized and hi < d */
+uint64_t udiv128_knuth(uint64_t hi, uint64_t lo, uint64_t d) {
+  const uint64_t b = 1ULL << 32;
+  uint64_t d1 = d >> 32;
+  uint64_t d0 = d & 0xffffffff;
+  uint64_t lo1 = lo >> 32;
+  uint64_t lo0 = lo & 0xffffffff;
+
+  uint64_t q1 = hi / d1;
+  uint64_t rhat = hi - q1 * d1;
+  while (q1 >= b || q1 * d0 > b * rhat + lo1) {
+    q1--;
+    rhat += d1;
+    if (rhat >= b) {
+      break;
+    }
+  }
+  /* remainder of the first digit, the subtraction wraps to a value < d */
+  uint64_t r = hi * b + lo1 - q1 * d;
+
+  uint64_t q0 = r / d1;
+  rhat = r - q0 * d1;
+  while (q0 >= b || q0 * d0 > b * rhat + lo0) {
+    q0--;
+    rhat += d1;
+    if (rhat >= b) {
+      break;
+    }
+  }
+  return q1 * b + q0;
+}
+
+int init_udiv128_divisor(uint64_t d, udiv128_divisor_t *divisor) {
+  if (d == 0) {
+    return ERROR_OVERFLOW;
+  }
+  divisor->shift = __builtin_clzll(d);
+  divisor->d = d << divisor->shift;
+  /* (2^128 - 1) - 2^64 * d, hi part is ~d which is less than d */
+  divisor->v = udiv128_knuth(~divisor->d, ~0ULL, divisor->d);
+  return CKB_SUCCESS;
+}
+
+/* floor(a * b / divisor), the quotient must fit in u64 */
+int udiv128_mul_div(uint64_t a, uint64_t b, const udiv128_divisor_t *divisor,
+                    uint64_t *quotient) {
+  uint128_t p = (uint128_t)a * b;
+  int s = divisor->shift;
+  uint64_t hi = (uint64_t)(p >> 64);
+  uint64_t lo = (uint64_t)p;
+  /* normalize the dividend with the divisor */
+  if (s > 0) {
+    if ((hi >> (64 - s)) != 0) {
+      return ERROR_OVERFLOW;
+    }
+    hi = (hi << s) | (lo >> (64 - s));
+    lo <<= s;
+  }
+  if (hi >= divisor->d) {
+    return ERROR_OVERFLOW;
+  }
+
+  /* 2 by 1 division with the reciprocal */
+  uint128_t q = (uint128_t)divisor->v * hi + (((uint128_t)hi << 64) | lo);
+  uint64_t q1 = (uint64_t)(q >> 64) + 1;
+  uint64_t q0 = (uint64_t)q;
+  uint64_t r = lo - q1 * divisor->d;
+  if (r > q0) {
+    q1--;
+    r += divisor->d;
+  }
+  if (r >= divisor->d) {
+    q1++;
+  }
+  *quotient = q1;
+  return CKB_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*
+witness.h
+
+Read WitnessArgs fields without copying the whole witness.
+
+The first WITNESS_PREFIX_SIZE bytes of a witness are loaded at once, they
+cover the WitnessArgs header and the fields of a short witness. A field
+beyond the prefix is fetched by a partial load at its offset, so a witness
+carrying a large signature or extra data costs no more than a short one.
+
+The structure is verified as MolReader_WitnessArgs_verify(witness, false)
+does, the content of fields is only read when asked.
+*/
+
+#ifndef DCKB_WITNESS_H
+#define DCKB_WITNESS_H
+
+#define WITNESS_ARGS_LOCK 0
+#define WITNESS_ARGS_INPUT_TYPE 1
+#define WITNESS_ARGS_OUTPUT_TYPE 2
+#define WITNESS_ARGS_FIELD_COUNT 3
+#define WITNESS_ARGS_HEADER_SIZE \
+  (MOL_NUM_T_SIZE * (WITNESS_ARGS_FIELD_COUNT + 1))
+#define WITNESS_PREFIX_SIZE 128
+
+typedef struct {
+  uint64_t index;
+  uint64_t source;
+  /* the beginning of the witness */
+  uint8_t prefix[WITNESS_PREFIX_SIZE];
+  uint64_t prefix_len;
+  /* raw bytes of fields, has is 0 if the field is none */
+  uint8_t field_has[WITNESS_ARGS_FIELD_COUNT];
+  uint32_t field_offset[WITNESS_ARGS_FIELD_COUNT];
+  uint32_t field_size[WITNESS_ARGS_FIELD_COUNT];
+} witness_args_t;
+
+/* read len bytes of the witness at offset */
+int witness_args_read(const witness_args_t *witness, uint32_t offset,
+                      uint8_t *out, uint32_t len) {
+  if ((uint64_t)offset + len <= witness->prefix_len) {
+    memcpy(out, witness->prefix + offset, len);
+    return CKB_SUCCESS;
+  }
+  uint64_t actual_len = len;
+  int ret = ckb_load_witness(out, &actual_len, offset, witness->index,
+                             witness->source);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  if (actual_len < len) {
+    return ERROR_ENCODING;
+  }
+  return CKB_SUCCESS;
+}
+
+/* load and verify the WitnessArgs structure,
+ * return the syscall error or ERROR_ENCODING for a malformed witness */
+int load_witness_args(witness_args_t *witness, uint64_t index,
+                      uint64_t source) {
+  witness->index = index;
+  witness->source = source;
+  uint64_t witness_len = WITNESS_PREFIX_SIZE;
+  int ret = ckb_load_witness(witness->prefix, &witness_len, 0, index, source);
+  if (ret != CKB_SUCCESS) {
+    return ret;
+  }
+  witness->prefix_len =
+      witness_len < WITNESS_PREFIX_SIZE ? witness_len : WITNESS_PREFIX_SIZE;
+
+  /* header, exactly 3 fields */
+  if (witness_len < WITNESS_ARGS_HEADER_SIZE ||
+      mol_unpack_number(witness->prefix) != witness_len) {
+    return ERROR_ENCODING;
+  }
+  uint64_t offsets[WITNESS_ARGS_FIELD_COUNT + 1];
+  for (int i = 0; i < WITNESS_ARGS_FIELD_COUNT; i++) {
+    offsets[i] = mol_unpack_number(witness->prefix + MOL_NUM_T_SIZE * (i + 1));
+  }
+  offsets[WITNESS_ARGS_FIELD_COUNT] = witness_len;
+  if (offsets[0] != WITNESS_ARGS_HEADER_SIZE) {
+    return ERROR_ENCODING;
+  }
+  for (int i = 1; i <= WITNESS_ARGS_FIELD_COUNT; i++) {
+    if (offsets[i - 1] > offsets[i]) {
+      return ERROR_ENCODING;
+    }
+  }
+
+  /* fields are BytesOpt, empty or a Bytes */
+  for (int i = 0; i < WITNESS_ARGS_FIELD_COUNT; i++) {
+    uint64_t size = offsets[i + 1] - offsets[i];
+    witness->field_has[i] = size != 0;
+    witness->field_offset[i] = offsets[i] + MOL_NUM_T_SIZE;
+    witness->field_size[i] = 0;
+    if (size == 0) {
+      continue;
+    }
+    if (size < MOL_NUM_T_SIZE) {
+      return ERROR_ENCODING;
+    }
+    uint8_t item_count[MOL_NUM_T_SIZE];
+    ret = witness_args_read(witness, offsets[i], item_count, MOL_NUM_T_SIZE);
+    if (ret != CKB_SUCCESS) {
+      return ERROR_ENCODING;
+    }
+    if (MOL_NUM_T_SIZE + (uint64_t)mol_unpack_number(item_count) != size) {
+      return ERROR_ENCODING;
+    }
+    witness->field_size[i] = size - MOL_NUM_T_SIZE;
+  }
+  return CKB_SUCCESS;
+}
+
+/* copy the raw bytes of a field, fails if the field is none or its size is
+ * not len */
+int load_witness_args_field(const witness_args_t *witness, int field,
+                            uint8_t *out, uint32_t len) {
+  if (!witness->field_has[field] || witness->field_size[field] != len) {
+    return ERROR_ENCODING;
+  }
+  return witness_args_read(witness, witness->field_offset[field], out, len);
+}
+
+#endif
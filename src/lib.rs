@@ -5,5 +5,8 @@
 
 #![allow(clippy::unreadable_literal)]
 
+#[cfg(feature = "native-verifier")]
+pub mod native;
+pub mod selector;
 #[cfg(test)]
 mod tests;
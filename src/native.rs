@@ -0,0 +1,445 @@
+//! Native build of the scripts, for checking transactions off chain.
+//!
+//! Enabled by the `native-verifier` feature. The C sources of the scripts are
+//! compiled for the host against a syscall shim (c/native/ckb_syscalls.h),
+//! every load syscall of a script calls back into a [`Syscalls`] which serves
+//! the transaction as the script group sees it. A script returns the same code
+//! as in the VM, but cycles are not counted, so a passing transaction can
+//! still exceed the cycles limit on chain.
+//!
+//! [`TxSyscalls`] serves a resolved transaction to a lock or type script
+//! group, the same as the VM does.
+//!
+//! The syscall callback of a run and the arena of the scripts are thread
+//! local in C, scripts can run on several threads at once. Each thread that
+//! runs a script holds an arena of ARENA_SIZE bytes (c/arena.h).
+
+use ckb_script::DataLoader;
+use ckb_types::{
+    bytes::Bytes,
+    core::{cell::ResolvedTransaction, Capacity},
+    packed::{self, CellOutput},
+    prelude::*,
+};
+use std::os::raw::{c_int, c_void};
+use std::panic::{self, AssertUnwindSafe};
+use std::ptr;
+
+// syscall numbers
+pub const SYS_LOAD_TRANSACTION: u64 = 2051;
+pub const SYS_LOAD_SCRIPT: u64 = 2052;
+pub const SYS_LOAD_TX_HASH: u64 = 2061;
+pub const SYS_LOAD_SCRIPT_HASH: u64 = 2062;
+pub const SYS_LOAD_CELL: u64 = 2071;
+pub const SYS_LOAD_HEADER: u64 = 2072;
+pub const SYS_LOAD_INPUT: u64 = 2073;
+pub const SYS_LOAD_WITNESS: u64 = 2074;
+pub const SYS_LOAD_CELL_BY_FIELD: u64 = 2081;
+pub const SYS_LOAD_HEADER_BY_FIELD: u64 = 2082;
+pub const SYS_LOAD_INPUT_BY_FIELD: u64 = 2083;
+pub const SYS_LOAD_CELL_DATA: u64 = 2092;
+
+// sources
+pub const SOURCE_INPUT: u64 = 1;
+pub const SOURCE_OUTPUT: u64 = 2;
+pub const SOURCE_CELL_DEP: u64 = 3;
+pub const SOURCE_HEADER_DEP: u64 = 4;
+pub const SOURCE_GROUP_INPUT: u64 = 0x0100_0000_0000_0001;
+pub const SOURCE_GROUP_OUTPUT: u64 = 0x0100_0000_0000_0002;
+
+// cell fields
+pub const CELL_FIELD_CAPACITY: u64 = 0;
+pub const CELL_FIELD_DATA_HASH: u64 = 1;
+pub const CELL_FIELD_LOCK: u64 = 2;
+pub const CELL_FIELD_LOCK_HASH: u64 = 3;
+pub const CELL_FIELD_TYPE: u64 = 4;
+pub const CELL_FIELD_TYPE_HASH: u64 = 5;
+pub const CELL_FIELD_OCCUPIED_CAPACITY: u64 = 6;
+
+// input fields
+pub const INPUT_FIELD_OUT_POINT: u64 = 0;
+pub const INPUT_FIELD_SINCE: u64 = 1;
+
+// syscall errors
+pub const INDEX_OUT_OF_BOUND: u8 = 1;
+pub const ITEM_MISSING: u8 = 2;
+
+/// Transaction of a script group.
+pub trait Syscalls {
+    /// Returns the whole item of a load syscall, or INDEX_OUT_OF_BOUND /
+    /// ITEM_MISSING. index, source and field are 0 if the syscall has no
+    /// such argument, offset and length are applied by the caller.
+    ///
+    /// A panic aborts the process, it can't unwind through the C code.
+    fn load(&self, syscall: u64, index: u64, source: u64, field: u64) -> Result<Vec<u8>, u8>;
+}
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Script {
+    Dckb,
+    DaoLock,
+    CustodianLock,
+}
+
+type LoadFn = extern "C" fn(
+    ctx: *mut c_void,
+    syscall: u64,
+    addr: *mut c_void,
+    len: *mut u64,
+    offset: usize,
+    index: usize,
+    source: usize,
+    field: usize,
+) -> c_int;
+
+extern "C" {
+    fn dckb_native_main(load: LoadFn, ctx: *mut c_void) -> c_int;
+    fn dao_lock_native_main(load: LoadFn, ctx: *mut c_void) -> c_int;
+    fn custodian_lock_native_main(load: LoadFn, ctx: *mut c_void) -> c_int;
+}
+
+extern "C" fn load(
+    ctx: *mut c_void,
+    syscall: u64,
+    addr: *mut c_void,
+    len: *mut u64,
+    offset: usize,
+    index: usize,
+    source: usize,
+    field: usize,
+) -> c_int {
+    let syscalls = unsafe { &*(ctx as *const &dyn Syscalls) };
+    let item = match panic::catch_unwind(AssertUnwindSafe(|| {
+        syscalls.load(syscall, index as u64, source as u64, field as u64)
+    })) {
+        Ok(Ok(item)) => item,
+        Ok(Err(code)) => return c_int::from(code),
+        Err(_) => std::process::abort(),
+    };
+    // same as the VM, copy at most *len bytes from offset and return the
+    // size from offset
+    let offset = offset.min(item.len());
+    let full_size = item.len() - offset;
+    unsafe {
+        let real_size = (*len as usize).min(full_size);
+        ptr::copy_nonoverlapping(item[offset..].as_ptr(), addr as *mut u8, real_size);
+        *len = full_size as u64;
+    }
+    0
+}
+
+/// Runs a script against the transaction served by syscalls, returns the exit
+/// code of the script, 0 is success.
+pub fn verify(script: Script, syscalls: &dyn Syscalls) -> i8 {
+    let ctx = &syscalls as *const &dyn Syscalls as *mut c_void;
+    let ret = unsafe {
+        match script {
+            Script::Dckb => dckb_native_main(load, ctx),
+            Script::DaoLock => dao_lock_native_main(load, ctx),
+            Script::CustodianLock => custodian_lock_native_main(load, ctx),
+        }
+    };
+    ret as i8
+}
+
+/// The shared C helpers the scripts are built on, and the molecule reader
+/// they replace, for checking one against the other in tests.
+#[cfg(test)]
+pub(crate) mod helpers {
+    use super::{load, LoadFn, Syscalls};
+    use std::os::raw::{c_int, c_void};
+
+    extern "C" {
+        fn helpers_native_udiv128_mul_div(a: u64, b: u64, d: u64, quotient: *mut u64) -> c_int;
+        fn helpers_native_witness_args_field(
+            load: LoadFn,
+            ctx: *mut c_void,
+            field: c_int,
+            out: *mut u8,
+            len: *mut u32,
+        ) -> c_int;
+        fn helpers_native_mol_witness_args_field(
+            witness: *const u8,
+            witness_len: u32,
+            field: c_int,
+            out: *mut u8,
+            len: *mut u32,
+        ) -> c_int;
+        fn helpers_native_verify_script_layout(script: *const u8, len: u64, args_len: u64)
+            -> c_int;
+        fn helpers_native_mol_verify_script(script: *const u8, len: u32) -> c_int;
+    }
+
+    // WitnessArgs fields, see c/witness.h
+    pub const WITNESS_ARGS_FIELD_COUNT: c_int = 3;
+    // largest field a witness_args_field copies
+    const MAX_FIELD_SIZE: usize = 8 * 1024;
+
+    /// floor(a * b / d) by udiv128_mul_div, or the error code.
+    pub fn udiv128_mul_div(a: u64, b: u64, d: u64) -> Result<u64, i8> {
+        let mut quotient = 0;
+        match unsafe { helpers_native_udiv128_mul_div(a, b, d, &mut quotient) } {
+            0 => Ok(quotient),
+            ret => Err(ret as i8),
+        }
+    }
+
+    // calls a C field reader with a buffer of MAX_FIELD_SIZE, it returns 1 if
+    // the field is none
+    fn read_field(read: impl FnOnce(*mut u8, *mut u32) -> c_int) -> Result<Option<Vec<u8>>, i8> {
+        let mut out = vec![0u8; MAX_FIELD_SIZE];
+        let mut len = MAX_FIELD_SIZE as u32;
+        match read(out.as_mut_ptr(), &mut len) {
+            0 => {
+                out.truncate(len as usize);
+                Ok(Some(out))
+            }
+            1 => Ok(None),
+            ret => Err(ret as i8),
+        }
+    }
+
+    /// A field of the WitnessArgs of input 0 served by syscalls, read by
+    /// c/witness.h, None if the field is none.
+    pub fn witness_args_field(
+        syscalls: &dyn Syscalls,
+        field: c_int,
+    ) -> Result<Option<Vec<u8>>, i8> {
+        let ctx = &syscalls as *const &dyn Syscalls as *mut c_void;
+        read_field(|out, len| unsafe {
+            helpers_native_witness_args_field(load, ctx, field, out, len)
+        })
+    }
+
+    /// The same field by MolReader_WitnessArgs_verify and the molecule
+    /// getters, ERROR_ENCODING if the witness is malformed.
+    pub fn mol_witness_args_field(witness: &[u8], field: c_int) -> Result<Option<Vec<u8>>, i8> {
+        read_field(|out, len| unsafe {
+            helpers_native_mol_witness_args_field(
+                witness.as_ptr(),
+                witness.len() as u32,
+                field,
+                out,
+                len,
+            )
+        })
+    }
+
+    /// Exit code of verify_script_layout for a Script of args_len bytes args.
+    pub fn verify_script_layout(script: &[u8], args_len: usize) -> i8 {
+        let ret = unsafe {
+            helpers_native_verify_script_layout(
+                script.as_ptr(),
+                script.len() as u64,
+                args_len as u64,
+            )
+        };
+        ret as i8
+    }
+
+    /// 0 if MolReader_Script_verify(script, false) accepts script, otherwise
+    /// ERROR_ENCODING.
+    pub fn mol_verify_script(script: &[u8]) -> i8 {
+        unsafe { helpers_native_mol_verify_script(script.as_ptr(), script.len() as u32) as i8 }
+    }
+}
+
+/// Serves a resolved transaction to a script group.
+pub struct TxSyscalls<'a, DL> {
+    rtx: &'a ResolvedTransaction,
+    data_loader: &'a DL,
+    script: packed::Script,
+    group_inputs: Vec<usize>,
+    group_outputs: Vec<usize>,
+}
+
+impl<'a, DL: DataLoader> TxSyscalls<'a, DL> {
+    /// Serves the lock script group of script, the inputs locked by it.
+    pub fn new_lock(
+        rtx: &'a ResolvedTransaction,
+        data_loader: &'a DL,
+        script: packed::Script,
+    ) -> Self {
+        let hash = script.calc_script_hash();
+        let group_inputs = rtx
+            .resolved_inputs
+            .iter()
+            .enumerate()
+            .filter(|(_, cell)| cell.cell_output.lock().calc_script_hash() == hash)
+            .map(|(i, _)| i)
+            .collect();
+        TxSyscalls {
+            rtx,
+            data_loader,
+            script,
+            group_inputs,
+            group_outputs: Vec::new(),
+        }
+    }
+
+    /// Serves the type script group of script, the inputs and outputs of
+    /// that type.
+    pub fn new_type(
+        rtx: &'a ResolvedTransaction,
+        data_loader: &'a DL,
+        script: packed::Script,
+    ) -> Self {
+        let hash = script.calc_script_hash();
+        let in_group = |output: &CellOutput| {
+            output
+                .type_()
+                .to_opt()
+                .map(|s| s.calc_script_hash() == hash)
+                .unwrap_or(false)
+        };
+        let group_inputs = rtx
+            .resolved_inputs
+            .iter()
+            .enumerate()
+            .filter(|(_, cell)| in_group(&cell.cell_output))
+            .map(|(i, _)| i)
+            .collect();
+        let group_outputs = rtx
+            .transaction
+            .outputs()
+            .into_iter()
+            .enumerate()
+            .filter(|(_, output)| in_group(output))
+            .map(|(i, _)| i)
+            .collect();
+        TxSyscalls {
+            rtx,
+            data_loader,
+            script,
+            group_inputs,
+            group_outputs,
+        }
+    }
+
+    fn group_index(&self, index: u64, source: u64) -> Result<(u64, usize), u8> {
+        let index = index as usize;
+        let (source, index) = match source {
+            SOURCE_GROUP_INPUT => (SOURCE_INPUT, self.group_inputs.get(index)),
+            SOURCE_GROUP_OUTPUT => (SOURCE_OUTPUT, self.group_outputs.get(index)),
+            _ => return Ok((source, index)),
+        };
+        index.map(|&i| (source, i)).ok_or(INDEX_OUT_OF_BOUND)
+    }
+
+    fn cell(&self, index: u64, source: u64) -> Result<(CellOutput, Bytes), u8> {
+        let (source, index) = self.group_index(index, source)?;
+        let meta = match source {
+            SOURCE_INPUT => self.rtx.resolved_inputs.get(index),
+            SOURCE_CELL_DEP => self.rtx.resolved_cell_deps.get(index),
+            SOURCE_OUTPUT => {
+                let tx = &self.rtx.transaction;
+                return match (tx.outputs().get(index), tx.outputs_data().get(index)) {
+                    (Some(output), Some(data)) => Ok((output, data.raw_data())),
+                    _ => Err(INDEX_OUT_OF_BOUND),
+                };
+            }
+            _ => None,
+        };
+        let meta = meta.ok_or(INDEX_OUT_OF_BOUND)?;
+        let (data, _) = self.data_loader.load_cell_data(meta).ok_or(ITEM_MISSING)?;
+        Ok((meta.cell_output.clone(), data))
+    }
+
+    fn header(&self, index: u64, source: u64) -> Result<Vec<u8>, u8> {
+        let (source, index) = self.group_index(index, source)?;
+        let tx = &self.rtx.transaction;
+        let block_hash = match source {
+            SOURCE_HEADER_DEP => tx.header_deps().get(index).ok_or(INDEX_OUT_OF_BOUND)?,
+            SOURCE_INPUT | SOURCE_CELL_DEP => {
+                let cells = if source == SOURCE_INPUT {
+                    &self.rtx.resolved_inputs
+                } else {
+                    &self.rtx.resolved_cell_deps
+                };
+                let meta = cells.get(index).ok_or(INDEX_OUT_OF_BOUND)?;
+                let block_hash = meta
+                    .transaction_info
+                    .as_ref()
+                    .map(|info| info.block_hash.clone())
+                    .ok_or(ITEM_MISSING)?;
+                // the VM only serves headers in header deps
+                if !tx.header_deps().into_iter().any(|hash| hash == block_hash) {
+                    return Err(ITEM_MISSING);
+                }
+                block_hash
+            }
+            _ => return Err(INDEX_OUT_OF_BOUND),
+        };
+        self.data_loader
+            .get_header(&block_hash)
+            .map(|header| header.data().as_slice().to_vec())
+            .ok_or(ITEM_MISSING)
+    }
+}
+
+impl<'a, DL: DataLoader> Syscalls for TxSyscalls<'a, DL> {
+    fn load(&self, syscall: u64, index: u64, source: u64, field: u64) -> Result<Vec<u8>, u8> {
+        let tx = &self.rtx.transaction;
+        match syscall {
+            SYS_LOAD_TRANSACTION => Ok(tx.data().as_slice().to_vec()),
+            SYS_LOAD_SCRIPT => Ok(self.script.as_slice().to_vec()),
+            SYS_LOAD_TX_HASH => Ok(tx.hash().as_slice().to_vec()),
+            SYS_LOAD_SCRIPT_HASH => Ok(self.script.calc_script_hash().as_slice().to_vec()),
+            SYS_LOAD_CELL => self
+                .cell(index, source)
+                .map(|(output, _)| output.as_slice().to_vec()),
+            SYS_LOAD_CELL_DATA => self.cell(index, source).map(|(_, data)| data.to_vec()),
+            SYS_LOAD_CELL_BY_FIELD => {
+                let (output, data) = self.cell(index, source)?;
+                let script = |script: Option<packed::Script>, hash: bool| {
+                    script
+                        .map(|s| {
+                            if hash {
+                                s.calc_script_hash().as_slice().to_vec()
+                            } else {
+                                s.as_slice().to_vec()
+                            }
+                        })
+                        .ok_or(ITEM_MISSING)
+                };
+                match field {
+                    CELL_FIELD_CAPACITY => Ok(output.capacity().as_slice().to_vec()),
+                    CELL_FIELD_DATA_HASH => {
+                        Ok(CellOutput::calc_data_hash(&data).as_slice().to_vec())
+                    }
+                    CELL_FIELD_LOCK => script(Some(output.lock()), false),
+                    CELL_FIELD_LOCK_HASH => script(Some(output.lock()), true),
+                    CELL_FIELD_TYPE => script(output.type_().to_opt(), false),
+                    CELL_FIELD_TYPE_HASH => script(output.type_().to_opt(), true),
+                    CELL_FIELD_OCCUPIED_CAPACITY => Capacity::bytes(data.len())
+                        .and_then(|data_capacity| output.occupied_capacity(data_capacity))
+                        .map(|capacity| capacity.as_u64().to_le_bytes().to_vec())
+                        .map_err(|_| ITEM_MISSING),
+                    _ => Err(ITEM_MISSING),
+                }
+            }
+            SYS_LOAD_HEADER => self.header(index, source),
+            SYS_LOAD_INPUT | SYS_LOAD_INPUT_BY_FIELD => {
+                let index = match self.group_index(index, source)? {
+                    (SOURCE_INPUT, index) => index,
+                    _ => return Err(INDEX_OUT_OF_BOUND),
+                };
+                let input = tx.inputs().get(index).ok_or(INDEX_OUT_OF_BOUND)?;
+                match (syscall, field) {
+                    (SYS_LOAD_INPUT, _) => Ok(input.as_slice().to_vec()),
+                    (_, INPUT_FIELD_OUT_POINT) => Ok(input.previous_output().as_slice().to_vec()),
+                    (_, INPUT_FIELD_SINCE) => Ok(input.since().as_slice().to_vec()),
+                    _ => Err(ITEM_MISSING),
+                }
+            }
+            SYS_LOAD_WITNESS => {
+                let (_, index) = self.group_index(index, source)?;
+                tx.witnesses()
+                    .get(index)
+                    .map(|witness| witness.raw_data().to_vec())
+                    .ok_or(INDEX_OUT_OF_BOUND)
+            }
+            _ => Err(ITEM_MISSING),
+        }
+    }
+}
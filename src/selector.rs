@@ -0,0 +1,205 @@
+//! DCKB input selection for transfers.
+//!
+//! The cycles of a DCKB transfer grow with the input DCKB cells and with the
+//! header deps the scripts align them against. Given the DCKB cells of a
+//! wallet, a target amount and an align target, [`select`] picks the inputs
+//! that cover the amount from the fewest deposit heights, then the fewest
+//! cells, and lays out the header deps and the witness header hints for them.
+//!
+//! Amounts are aligned as the dckb script does, `amount * target accumulate
+//! rate / deposit accumulate rate` rounded down for each cell.
+
+use std::collections::HashMap;
+
+/// Header deps the scripts can index by a u8 hint, see c/header_table.h
+pub const MAX_HEADER_DEPS: usize = 256;
+
+/// A DCKB cell of the wallet.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct DckbCell {
+    /// amount in the cell data
+    pub amount: u64,
+    /// block the amount is aligned from, the block number in the cell data,
+    /// or the block committing the cell for a new DCKB cell (block number 0
+    /// in the data)
+    pub deposit_block_number: u64,
+}
+
+/// Block number and accumulate rate of a header.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct DaoHeader {
+    pub block_number: u64,
+    pub accumulate_rate: u64,
+}
+
+impl DaoHeader {
+    /// Reads the accumulate rate from the dao field of a header.
+    pub fn from_dao(block_number: u64, dao: &[u8; 32]) -> Self {
+        let mut buf = [0u8; 8];
+        buf.copy_from_slice(&dao[8..16]);
+        DaoHeader {
+            block_number,
+            accumulate_rate: u64::from_le_bytes(buf),
+        }
+    }
+}
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum Error {
+    /// no header is given for the deposit block number
+    UnknownHeader(u64),
+    /// the aligned total of the usable cells is below the target amount,
+    /// cells deposited after the align target are not usable
+    NotEnough {
+        available: u64,
+    },
+    TooManyHeaderDeps,
+    Overflow,
+}
+
+/// Inputs and header deps of a transfer.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Selection {
+    /// indexes of the selected cells, in the order of inputs
+    pub inputs: Vec<usize>,
+    /// aligned total of the selected cells
+    pub aligned_amount: u64,
+    /// block numbers of the header deps, the align target first, then the
+    /// deposit headers by the number of inputs using them. Other header deps
+    /// of the transaction must come after them.
+    pub header_deps: Vec<u64>,
+    /// header deps index of the deposit header of each input
+    pub header_hints: Vec<u8>,
+}
+
+impl Selection {
+    /// The witness input_type of the align target, <target block number> |
+    /// <target header index> | <deposit header index>..., the DCKB inputs of
+    /// the transaction must be the selected inputs in order.
+    pub fn input_type(&self) -> Vec<u8> {
+        let mut input_type = self.header_deps[0].to_le_bytes().to_vec();
+        input_type.push(0);
+        input_type.extend_from_slice(&self.header_hints);
+        input_type
+    }
+}
+
+/// Aligns an amount deposited at deposit to target.
+pub fn align_amount(amount: u64, deposit: &DaoHeader, target: &DaoHeader) -> Result<u64, Error> {
+    if deposit.block_number == target.block_number {
+        return Ok(amount);
+    }
+    if deposit.accumulate_rate == 0 {
+        return Err(Error::Overflow);
+    }
+    let aligned = u128::from(amount) * u128::from(target.accumulate_rate)
+        / u128::from(deposit.accumulate_rate);
+    if aligned > u128::from(std::u64::MAX) {
+        return Err(Error::Overflow);
+    }
+    Ok(aligned as u64)
+}
+
+/// Selects the cells to transfer at least amount aligned to target.
+///
+/// Taking the k deposit heights with the largest aligned totals covers the
+/// most of any k heights, so the first k covering the amount is the fewest
+/// headers. The largest cells of those heights are then taken until the
+/// amount is covered, which may drop a height. Cells deposited after target
+/// are skipped.
+pub fn select(
+    cells: &[DckbCell],
+    headers: &[DaoHeader],
+    target: &DaoHeader,
+    amount: u64,
+) -> Result<Selection, Error> {
+    let headers: HashMap<u64, &DaoHeader> = headers
+        .iter()
+        .map(|header| (header.block_number, header))
+        .collect();
+
+    // aligned usable cells by deposit height
+    let mut heights: HashMap<u64, (u128, Vec<(usize, u64)>)> = HashMap::new();
+    for (i, cell) in cells.iter().enumerate() {
+        if cell.deposit_block_number > target.block_number {
+            continue;
+        }
+        let deposit = if cell.deposit_block_number == target.block_number {
+            target
+        } else {
+            headers
+                .get(&cell.deposit_block_number)
+                .ok_or(Error::UnknownHeader(cell.deposit_block_number))?
+        };
+        let aligned = align_amount(cell.amount, deposit, target)?;
+        let height = heights.entry(cell.deposit_block_number).or_default();
+        height.0 += u128::from(aligned);
+        height.1.push((i, aligned));
+    }
+    let mut heights: Vec<_> = heights.into_iter().collect();
+    heights.sort_by(
+        |(a_number, (a_total, a_cells)), (b_number, (b_total, b_cells))| {
+            b_total
+                .cmp(a_total)
+                .then(a_cells.len().cmp(&b_cells.len()))
+                .then(a_number.cmp(b_number))
+        },
+    );
+
+    let mut covered = 0u128;
+    let mut candidates = Vec::new();
+    for (_, (total, height_cells)) in heights.iter() {
+        if covered >= u128::from(amount) {
+            break;
+        }
+        covered += total;
+        candidates.extend_from_slice(height_cells);
+    }
+    if covered < u128::from(amount) {
+        let available = covered.min(u128::from(std::u64::MAX)) as u64;
+        return Err(Error::NotEnough { available });
+    }
+
+    candidates.sort_by(|(a, a_aligned), (b, b_aligned)| b_aligned.cmp(a_aligned).then(a.cmp(b)));
+    let mut aligned_amount = 0u64;
+    let mut inputs = Vec::new();
+    for &(i, aligned) in candidates.iter() {
+        if aligned_amount >= amount {
+            break;
+        }
+        aligned_amount = aligned_amount.checked_add(aligned).ok_or(Error::Overflow)?;
+        inputs.push(i);
+    }
+
+    // header deps, the align target then deposit heights by use
+    let mut uses: HashMap<u64, usize> = HashMap::new();
+    for &i in inputs.iter() {
+        *uses.entry(cells[i].deposit_block_number).or_default() += 1;
+    }
+    uses.remove(&target.block_number);
+    let mut deposit_heights: Vec<(u64, usize)> = uses.into_iter().collect();
+    deposit_heights.sort_by(|(a, a_uses), (b, b_uses)| b_uses.cmp(a_uses).then(a.cmp(b)));
+    let mut header_deps = vec![target.block_number];
+    header_deps.extend(deposit_heights.into_iter().map(|(number, _)| number));
+    if header_deps.len() > MAX_HEADER_DEPS {
+        return Err(Error::TooManyHeaderDeps);
+    }
+    let header_index: HashMap<u64, u8> = header_deps
+        .iter()
+        .enumerate()
+        .map(|(index, &number)| (number, index as u8))
+        .collect();
+
+    // inputs of the same height are adjacent, in header deps order
+    inputs.sort_by_key(|&i| (header_index[&cells[i].deposit_block_number], i));
+    let header_hints = inputs
+        .iter()
+        .map(|&i| header_index[&cells[i].deposit_block_number])
+        .collect();
+    Ok(Selection {
+        inputs,
+        aligned_amount,
+        header_deps,
+        header_hints,
+    })
+}
@@ -0,0 +1,880 @@
+//! Cycle benchmarks
+//!
+//! Builds parameterized transactions for each DCKB operation, reports the
+//! cycles of each DCKB script group verifying them and fails when a group
+//! exceeds its budget in `cycle_budgets.txt`. A group without a budget is
+//! reported, and fails only `make bench` (`DCKB_REQUIRE_CYCLE_BUDGETS`).
+//!
+//! Run `make bench` to see the report, `make bench-update` to rewrite the
+//! budgets with the measured cycles, `make bench-profiles` to compare the
+//! cycles of build profiles, `make bench-phases` to break the cycles down by
+//! script phase, `make flamegraph SCENARIO=<scenario>` for the flamegraphs
+//! of a scenario.
+
+use super::replay::Outcome;
+use super::*;
+use ckb_jsonrpc_types as json;
+use ckb_script::TransactionScriptsVerifier;
+use ckb_types::{
+    bytes::Bytes,
+    core::{
+        cell::{CellMetaBuilder, ResolvedTransaction},
+        Capacity, TransactionBuilder, TransactionInfo,
+    },
+    packed::{CellInput, WitnessArgs},
+    prelude::*,
+};
+use serde_json::json;
+use std::{collections::HashSet, env, fs};
+
+const BUDGETS: &str = include_str!("cycle_budgets.txt");
+const BUDGETS_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/src/tests/cycle_budgets.txt");
+const UPDATE_BUDGETS_ENV: &str = "DCKB_UPDATE_CYCLE_BUDGETS";
+// fail on a script group without a budget
+const REQUIRE_BUDGETS_ENV: &str = "DCKB_REQUIRE_CYCLE_BUDGETS";
+// path to write the measured cycles of scenarios
+const REPORT_ENV: &str = "DCKB_BENCH_REPORT";
+// path to record the scenarios as a replay corpus, see replay.rs
+const CORPUS_RECORD_ENV: &str = "DCKB_CORPUS_RECORD";
+// scenario to write as a ckb-debugger mock transaction, and the directory
+const MOCK_TX_ENV: &str = "DCKB_MOCK_TX";
+const MOCK_TX_DIR_ENV: &str = "DCKB_MOCK_TX_DIR";
+
+// capacity of each NervosDAO cell
+const DAO_CAPACITY: u64 = 1000_00000000;
+// since of phase2 inputs, same as test_dao_lock_phase2_unlock
+const PHASE2_SINCE: u64 = 0x2003e8022a0002f3;
+
+#[derive(Clone, Copy)]
+enum Operation {
+    Deposit,
+    Transfer,
+    Phase1,
+    Phase2,
+}
+
+struct Scenario {
+    operation: Operation,
+    cells: usize,
+    header_deps: usize,
+    // dao_lock groups of different refund locks, a batch if more than 1
+    groups: usize,
+    // phase2 DCKB inputs more, of deposit and withdraw heights in turn
+    dckb_inputs: usize,
+}
+
+impl Scenario {
+    fn new(operation: Operation, cells: usize, header_deps: usize) -> Self {
+        Scenario {
+            operation,
+            cells,
+            header_deps,
+            groups: 1,
+            dckb_inputs: 0,
+        }
+    }
+
+    // `groups` dao_lock groups of a cell each share a custodian cell
+    fn batch(operation: Operation, groups: usize, header_deps: usize) -> Self {
+        Scenario {
+            operation,
+            cells: groups,
+            header_deps,
+            groups,
+            dckb_inputs: 0,
+        }
+    }
+
+    // a phase2 withdraw of `cells` DAO cells that destroys DCKB of
+    // `dckb_inputs` more inputs, the dao_lock alignment sorts them by height
+    fn interleaved(cells: usize, dckb_inputs: usize, header_deps: usize) -> Self {
+        Scenario {
+            operation: Operation::Phase2,
+            cells,
+            header_deps,
+            groups: 1,
+            dckb_inputs,
+        }
+    }
+
+    fn name(&self) -> String {
+        let operation = match self.operation {
+            Operation::Deposit => "deposit",
+            Operation::Transfer => "transfer",
+            Operation::Phase1 => "phase1",
+            Operation::Phase2 => "phase2",
+        };
+        if self.dckb_inputs > 0 {
+            return format!(
+                "{}_cells{}_dckb{}_headers{}",
+                operation, self.cells, self.dckb_inputs, self.header_deps
+            );
+        }
+        if self.groups > 1 {
+            return format!(
+                "{}_groups{}_headers{}",
+                operation, self.groups, self.header_deps
+            );
+        }
+        format!("{}_cells{}_headers{}", operation, self.cells, self.header_deps)
+    }
+
+    fn build(&self) -> (DummyDataLoader, ResolvedTransaction) {
+        match self.operation {
+            Operation::Deposit => deposit_tx(self.cells),
+            Operation::Transfer => transfer_tx(self.cells, self.header_deps),
+            Operation::Phase1 => phase1_tx(self.cells, self.header_deps, self.groups),
+            Operation::Phase2 => {
+                phase2_tx(self.cells, self.header_deps, self.groups, self.dckb_inputs)
+            }
+        }
+    }
+}
+
+// NervosDAO limits a transaction to 64 outputs, a deposit outputs 2 cells per
+// DAO cell and a phase1 withdraw outputs 1 cell per DAO cell, plus the change.
+// The phase2 custodian cell index must fit in the 1 byte witness. A phase2
+// batch outputs a refund cell for each group plus the DCKB change.
+fn scenarios() -> Vec<Scenario> {
+    let mut scenarios = Vec::new();
+    for &cells in &[1, 8, 31] {
+        scenarios.push(Scenario::new(Operation::Deposit, cells, 0));
+    }
+    for &header_deps in &[2, 64] {
+        for &cells in &[1, 8, 64, 255] {
+            scenarios.push(Scenario::new(Operation::Transfer, cells, header_deps));
+        }
+        for &cells in &[1, 8, 62] {
+            scenarios.push(Scenario::new(Operation::Phase1, cells, header_deps));
+        }
+        for &cells in &[1, 8, 64, 254] {
+            scenarios.push(Scenario::new(Operation::Phase2, cells, header_deps));
+        }
+    }
+    for &groups in &[8, 62] {
+        scenarios.push(Scenario::batch(Operation::Phase1, groups, 2));
+    }
+    for &groups in &[8, 63] {
+        scenarios.push(Scenario::batch(Operation::Phase2, groups, 2));
+    }
+    for &dckb_inputs in &[64, 240] {
+        scenarios.push(Scenario::interleaved(8, dckb_inputs, 2));
+    }
+    scenarios
+}
+
+// budgets by (scenario, script)
+fn load_budgets() -> HashMap<(String, String), u64> {
+    BUDGETS
+        .lines()
+        .map(|line| line.trim())
+        .filter(|line| !line.is_empty() && !line.starts_with('#'))
+        .map(|line| {
+            let mut fields = line.split_whitespace();
+            let name = fields.next().expect("scenario name").to_string();
+            let script = fields.next().expect("script name").to_string();
+            let cycles = fields
+                .next()
+                .expect("script budget")
+                .parse()
+                .expect("parse budget");
+            ((name, script), cycles)
+        })
+        .collect()
+}
+
+fn write_budgets(report: &[(String, &'static str, u64)]) {
+    let mut content: String = BUDGETS
+        .lines()
+        .take_while(|line| line.starts_with('#'))
+        .map(|line| format!("{}\n", line))
+        .collect();
+    content.push('\n');
+    for (name, script, cycles) in report {
+        content.push_str(&format!("{} {} {}\n", name, script, cycles));
+    }
+    fs::write(BUDGETS_PATH, content).expect("write budgets");
+}
+
+struct BenchHeaders {
+    deposit: HeaderView,
+    withdraw: HeaderView,
+    noise: Vec<HeaderView>,
+}
+
+impl BenchHeaders {
+    // header deps are the two given headers then the noise headers
+    fn header_deps(&self, first: &HeaderView, second: &HeaderView) -> Vec<Byte32> {
+        let mut header_deps = vec![first.hash(), second.hash()];
+        header_deps.extend(self.noise.iter().map(|header| header.hash()));
+        header_deps
+    }
+}
+
+// same deposit and withdraw headers as other tests, plus unrelated headers to
+// fill header deps up to `header_deps`
+fn gen_bench_headers(data_loader: &mut DummyDataLoader, header_deps: usize) -> BenchHeaders {
+    let (deposit, deposit_epoch) = gen_header(1554, 10000000, 35, 1000, 1000);
+    let (withdraw, withdraw_epoch) = gen_header(2000610, 10001000, 575, 2000000, 1100);
+    let mut epoches = vec![(deposit.clone(), deposit_epoch), (withdraw.clone(), withdraw_epoch)];
+    let mut noise = Vec::new();
+    for i in 0..header_deps.saturating_sub(2) {
+        let number = 10 + i as u64 * 40000;
+        let (header, epoch) = gen_header(number, 10000000 + i as u64, i as u64, number, 1000);
+        epoches.push((header.clone(), epoch));
+        noise.push(header);
+    }
+    for (header, epoch) in epoches {
+        data_loader.headers.insert(header.hash(), header.clone());
+        data_loader.epoches.insert(header.hash(), epoch);
+    }
+    BenchHeaders {
+        deposit,
+        withdraw,
+        noise,
+    }
+}
+
+fn transaction_info(header: &HeaderView) -> TransactionInfo {
+    TransactionInfo {
+        block_hash: header.hash(),
+        block_number: header.number(),
+        block_epoch: header.epoch(),
+        index: 0,
+    }
+}
+
+fn resolve_tx<F: FnOnce(TransactionView) -> TransactionView>(
+    data_loader: &mut DummyDataLoader,
+    builder: TransactionBuilder,
+    resolved_inputs: Vec<CellMeta>,
+    sign: F,
+) -> ResolvedTransaction {
+    let (tx, resolved_cell_deps) = complete_tx(data_loader, builder);
+    ResolvedTransaction {
+        transaction: sign(tx),
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    }
+}
+
+// one normal input deposits `cells` DAO cells and mints DCKB for each of them
+fn deposit_tx(cells: usize) -> (DummyDataLoader, ResolvedTransaction) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let (deposit_header, _) = gen_header(1554, 10000000, 35, 1000, 1000);
+
+    let change_coin = SECP_OCCUPIED_CAPACITY;
+    let input_capacity = (DAO_CAPACITY + DCKB_CAPACITY.as_u64()) * cells as u64 + change_coin;
+    let (cell, previous_out_point) = gen_normal_cell(
+        &mut data_loader,
+        Capacity::shannons(input_capacity),
+        lock_args.clone(),
+    );
+    let input_cell_meta = CellMetaBuilder::from_cell_output(cell, Bytes::new())
+        .out_point(previous_out_point.clone())
+        .transaction_info(transaction_info(&deposit_header))
+        .build();
+
+    let (change_output_cell, _) = gen_normal_cell(
+        &mut data_loader,
+        Capacity::shannons(change_coin),
+        lock_args.clone(),
+    );
+    let refund_lock_hash: [u8; 32] = change_output_cell.lock().calc_script_hash().unpack();
+    let mut builder = TransactionBuilder::default().input(CellInput::new(previous_out_point, 0));
+    for _ in 0..cells {
+        let (output_cell, _) = gen_dao_cell(
+            &mut data_loader,
+            Capacity::shannons(DAO_CAPACITY),
+            gen_dao_lock_lock_script(refund_lock_hash),
+        );
+        builder = builder
+            .output(output_cell)
+            .output_data(Bytes::from(vec![0u8; 8]).pack());
+    }
+    for _ in 0..cells {
+        let (dckb_output_cell, _, dckb_output_data) = gen_dckb_cell(
+            &mut data_loader,
+            DAO_CAPACITY - DAO_OCCUPIED_CAPACITY,
+            0,
+            lock_args.clone(),
+        );
+        builder = builder
+            .output(dckb_output_cell)
+            .output_data(dckb_output_data.pack());
+    }
+    builder = builder
+        .output(change_output_cell)
+        .output_data(Bytes::new().pack())
+        .witness(WitnessArgs::default().as_bytes().pack());
+
+    let rtx = resolve_tx(&mut data_loader, builder, vec![input_cell_meta], |tx| {
+        sign_tx(tx, &privkey)
+    });
+    (data_loader, rtx)
+}
+
+// `cells` DCKB inputs deposited at the deposit header are aligned to the
+// withdraw header
+fn transfer_tx(cells: usize, header_deps: usize) -> (DummyDataLoader, ResolvedTransaction) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let headers = gen_bench_headers(&mut data_loader, header_deps);
+
+    let amount = DAO_CAPACITY;
+    let mut builder = TransactionBuilder::default();
+    let mut resolved_inputs = Vec::new();
+    for i in 0..cells {
+        let (dckb_cell, dckb_previous_out_point, dckb_cell_data) = gen_dckb_cell(
+            &mut data_loader,
+            amount,
+            headers.deposit.number(),
+            lock_args.clone(),
+        );
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(dckb_cell, dckb_cell_data)
+                .out_point(dckb_previous_out_point.clone())
+                .transaction_info(transaction_info(&headers.deposit))
+                .build(),
+        );
+        let witness = if i == 0 {
+            WitnessArgs::new_builder()
+                .type_(Bytes::from(headers.withdraw.number().to_le_bytes().to_vec()).pack())
+                .build()
+        } else {
+            WitnessArgs::default()
+        };
+        builder = builder
+            .input(CellInput::new(dckb_previous_out_point, 0))
+            .output(dckb_cell_output())
+            .output_data(dckb_data(amount.into(), headers.withdraw.number()).pack())
+            .witness(witness.as_bytes().pack());
+    }
+    for header_dep in headers.header_deps(&headers.deposit, &headers.withdraw) {
+        builder = builder.header_dep(header_dep);
+    }
+
+    let rtx = resolve_tx(&mut data_loader, builder, resolved_inputs, |tx| {
+        sign_tx(tx, &privkey)
+    });
+    (data_loader, rtx)
+}
+
+// refund locks of `groups` dao_lock groups, the first one is of lock_args
+fn gen_refund_locks(lock_args: &Bytes, groups: usize) -> Vec<Script> {
+    (0..groups)
+        .map(|i| {
+            if i == 0 {
+                gen_secp256k1_lock_script(lock_args.clone())
+            } else {
+                gen_secp256k1_lock_script(gen_lock().1)
+            }
+        })
+        .collect()
+}
+
+// `cells` deposited DAO cells of `groups` dao locks start withdrawing, cell i
+// is of group i % groups. The DCKB of them are put into one custodian cell.
+fn phase1_tx(
+    cells: usize,
+    header_deps: usize,
+    groups: usize,
+) -> (DummyDataLoader, ResolvedTransaction) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let headers = gen_bench_headers(&mut data_loader, header_deps);
+    let deposit_number = headers.deposit.number();
+
+    let dao_lock_scripts: Vec<_> = gen_refund_locks(&lock_args, groups)
+        .iter()
+        .map(|lock| gen_dao_lock_lock_script(lock.calc_script_hash().unpack()))
+        .collect();
+    let custodian_amount = (DAO_CAPACITY - DAO_OCCUPIED_CAPACITY) * cells as u64;
+    let change_amount = DAO_CAPACITY;
+    let mut builder = TransactionBuilder::default();
+    let mut resolved_inputs = Vec::new();
+    // DAO inputs and their withdrawing outputs
+    for i in 0..cells {
+        let (cell, previous_out_point) = gen_dao_cell(
+            &mut data_loader,
+            Capacity::shannons(DAO_CAPACITY),
+            dao_lock_scripts[i % groups].clone(),
+        );
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell.clone(), Bytes::from(vec![0u8; 8]))
+                .out_point(previous_out_point.clone())
+                .transaction_info(transaction_info(&headers.deposit))
+                .build(),
+        );
+        builder = builder
+            .input(CellInput::new(previous_out_point, 0))
+            .output(cell)
+            .output_data(Bytes::from(deposit_number.to_le_bytes().to_vec()).pack());
+    }
+    // DCKB input covers the custodian amount
+    let (dckb_cell, dckb_previous_out_point, dckb_cell_data) = gen_dckb_cell(
+        &mut data_loader,
+        custodian_amount + change_amount,
+        0,
+        lock_args.clone(),
+    );
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(dckb_cell, dckb_cell_data)
+            .out_point(dckb_previous_out_point.clone())
+            .transaction_info(transaction_info(&headers.deposit))
+            .build(),
+    );
+    let (fee_input_cell, fee_input_out_point) = gen_normal_cell(
+        &mut data_loader,
+        Capacity::shannons(SECP_OCCUPIED_CAPACITY),
+        lock_args.clone(),
+    );
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(fee_input_cell, Bytes::new())
+            .out_point(fee_input_out_point.clone())
+            .build(),
+    );
+    // custodian and DCKB change outputs
+    let custodian_cell = CellOutput::new_builder()
+        .capacity(Capacity::shannons(SECP_OCCUPIED_CAPACITY).pack())
+        .lock(gen_custodian_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    let dckb_change_cell = CellOutput::new_builder()
+        .capacity(DCKB_CAPACITY.pack())
+        .lock(gen_secp256k1_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    builder = builder
+        .input(CellInput::new(dckb_previous_out_point, 0))
+        .input(CellInput::new(fee_input_out_point, 0))
+        .output(custodian_cell)
+        .output_data(dckb_data(custodian_amount.into(), deposit_number).pack())
+        .output(dckb_change_cell)
+        .output_data(dckb_data(change_amount.into(), deposit_number).pack());
+
+    // witnesses, the first input of each group points to the custodian cell
+    let custodian_cell_index = cells as u8;
+    let witness = WitnessArgs::new_builder()
+        .lock(Bytes::from(vec![custodian_cell_index]).pack())
+        .type_(Bytes::from(&0u8.to_le_bytes()[..]).pack())
+        .build();
+    builder = builder.witness(witness.as_bytes().pack());
+    for i in 1..cells {
+        let witness = if i < groups {
+            witness.clone()
+        } else {
+            WitnessArgs::default()
+        };
+        builder = builder.witness(witness.as_bytes().pack());
+    }
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(deposit_number.to_le_bytes().to_vec()).pack())
+        .build();
+    builder = builder.witness(dckb_witness.as_bytes().pack());
+    for header_dep in headers.header_deps(&headers.deposit, &headers.withdraw) {
+        builder = builder.header_dep(header_dep);
+    }
+
+    let rtx = resolve_tx(&mut data_loader, builder, resolved_inputs, |tx| {
+        sign_tx_by_input_group(tx, &privkey, cells, 2)
+    });
+    (data_loader, rtx)
+}
+
+// `cells` withdrawing DAO cells of `groups` dao locks are unlocked with the
+// custodian cell created in phase1, cell i is of group i % groups. The
+// compensation is destroyed from DCKB, and `dckb_inputs` more DCKB inputs
+// deposited at the deposit and the withdraw header in turn go to the change.
+fn phase2_tx(
+    cells: usize,
+    header_deps: usize,
+    groups: usize,
+    dckb_inputs: usize,
+) -> (DummyDataLoader, ResolvedTransaction) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let headers = gen_bench_headers(&mut data_loader, header_deps);
+    let withdraw_number = headers.withdraw.number();
+
+    let refund_locks = gen_refund_locks(&lock_args, groups);
+    let dao_lock_scripts: Vec<_> = refund_locks
+        .iter()
+        .map(|lock| gen_dao_lock_lock_script(lock.calc_script_hash().unpack()))
+        .collect();
+    let expected_withdraw_capacity = calculate_dao_capacity(
+        DAO_OCCUPIED_CAPACITY,
+        &headers.deposit,
+        &headers.withdraw,
+        DAO_CAPACITY,
+    ) * cells as u64;
+    // the DCKB custodied in phase1
+    let custodian_amount = (DAO_CAPACITY - DAO_OCCUPIED_CAPACITY) * cells as u64;
+    // covers the occupied capacity and the compensation
+    let input_dckb_amount = (DAO_OCCUPIED_CAPACITY + 100000000u64) * cells as u64;
+    // DAO inputs and the custodian cell are from the same phase1 tx
+    let phase1_tx_hash = generate_random_out_point().tx_hash();
+    let mut builder = TransactionBuilder::default();
+    let mut resolved_inputs = Vec::new();
+    for i in 0..cells {
+        let (cell, _) = gen_dao_cell(
+            &mut data_loader,
+            Capacity::shannons(DAO_CAPACITY),
+            dao_lock_scripts[i % groups].clone(),
+        );
+        let previous_out_point = OutPoint::new(phase1_tx_hash.clone(), i as u32);
+        let cell_data = Bytes::from(headers.deposit.number().to_le_bytes().to_vec());
+        data_loader
+            .cells
+            .insert(previous_out_point.clone(), (cell.clone(), cell_data.clone()));
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell, cell_data)
+                .out_point(previous_out_point.clone())
+                .transaction_info(transaction_info(&headers.withdraw))
+                .build(),
+        );
+        builder = builder.input(CellInput::new(previous_out_point, PHASE2_SINCE));
+    }
+    let (dckb_cell, dckb_previous_out_point, dckb_cell_data) =
+        gen_dckb_cell(&mut data_loader, input_dckb_amount, 0, lock_args.clone());
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(dckb_cell, dckb_cell_data)
+            .out_point(dckb_previous_out_point.clone())
+            .transaction_info(transaction_info(&headers.withdraw))
+            .build(),
+    );
+    // the more DCKB inputs follow, of the same lock
+    let mut extra_dckb_out_points = Vec::new();
+    let mut extra_dckb_amount = 0;
+    for i in 0..dckb_inputs {
+        let header = if i % 2 == 0 {
+            &headers.deposit
+        } else {
+            &headers.withdraw
+        };
+        let (cell, out_point, cell_data) = gen_dckb_cell(
+            &mut data_loader,
+            DAO_CAPACITY,
+            header.number(),
+            lock_args.clone(),
+        );
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell, cell_data)
+                .out_point(out_point.clone())
+                .transaction_info(transaction_info(header))
+                .build(),
+        );
+        extra_dckb_out_points.push(out_point);
+        extra_dckb_amount += calculate_dao_capacity(0, header, &headers.withdraw, DAO_CAPACITY);
+    }
+    let custodian_cell_out_point = OutPoint::new(phase1_tx_hash, cells as u32);
+    let (custodian_cell, custodian_cell_data) = gen_custodian_cell(
+        &mut data_loader,
+        custodian_amount,
+        withdraw_number,
+        lock_args.clone(),
+        custodian_cell_out_point.clone(),
+    );
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(custodian_cell, custodian_cell_data)
+            .out_point(custodian_cell_out_point.clone())
+            .transaction_info(transaction_info(&headers.withdraw))
+            .build(),
+    );
+
+    // refund CKB of each group, the DCKB change output refunds its capacity to
+    // the first group
+    for (group, refund_lock) in refund_locks.iter().enumerate() {
+        let group_cells = (group..cells).step_by(groups).count() as u64;
+        let mut refund_capacity = DAO_CAPACITY * group_cells;
+        if group == 0 {
+            refund_capacity -= DCKB_CAPACITY.as_u64();
+        }
+        let withdraw_cell = cell_output_with_only_capacity(refund_capacity)
+            .as_builder()
+            .lock(refund_lock.clone())
+            .build();
+        builder = builder
+            .output(withdraw_cell)
+            .output_data(Bytes::new().pack());
+    }
+    let dckb_change_cell = CellOutput::new_builder()
+        .capacity(DCKB_CAPACITY.pack())
+        .lock(gen_secp256k1_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    let dckb_change_data = dckb_data(
+        (input_dckb_amount + extra_dckb_amount + custodian_amount - expected_withdraw_capacity)
+            .into(),
+        withdraw_number,
+    );
+    builder = builder.input(CellInput::new(dckb_previous_out_point, 0));
+    for out_point in extra_dckb_out_points {
+        builder = builder.input(CellInput::new(out_point, 0));
+    }
+    builder = builder
+        .input(CellInput::new(custodian_cell_out_point, 0))
+        .output(dckb_change_cell)
+        .output_data(dckb_change_data.pack());
+
+    // witnesses, header deps are withdraw header then deposit header
+    let deposit_header_index = 1u64;
+    let custodian_cell_index = (cells + 1 + dckb_inputs) as u8;
+    for i in 0..cells {
+        let mut witness = WitnessArgs::new_builder()
+            .type_(Bytes::from(&deposit_header_index.to_le_bytes()[..]).pack());
+        // the first input of each group
+        if i < groups {
+            witness = witness.lock(Bytes::from(vec![custodian_cell_index]).pack());
+        }
+        builder = builder.witness(witness.build().as_bytes().pack());
+    }
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(withdraw_number.to_le_bytes().to_vec()).pack())
+        .build();
+    let unlock_input_cell_index = cells as u8;
+    let custodian_cell_witness = WitnessArgs::new_builder()
+        .lock(Bytes::from(vec![unlock_input_cell_index]).pack())
+        .type_(Bytes::from(vec![0]).pack())
+        .build();
+    builder = builder.witness(dckb_witness.as_bytes().pack());
+    for _ in 0..dckb_inputs {
+        builder = builder.witness(WitnessArgs::default().as_bytes().pack());
+    }
+    builder = builder.witness(custodian_cell_witness.as_bytes().pack());
+    for header_dep in headers.header_deps(&headers.withdraw, &headers.deposit) {
+        builder = builder.header_dep(header_dep);
+    }
+
+    let rtx = resolve_tx(&mut data_loader, builder, resolved_inputs, |tx| {
+        sign_tx_by_input_group(tx, &privkey, cells, 1 + dckb_inputs)
+    });
+    (data_loader, rtx)
+}
+
+#[test]
+fn bench_cycle_budgets() {
+    let budgets = load_budgets();
+    let update = env::var(UPDATE_BUDGETS_ENV).is_ok();
+    let mut report = Vec::new();
+    let mut exceeded = Vec::new();
+    let mut missing = Vec::new();
+    println!(
+        "{:<28} {:<16} {:>14} {:>14}",
+        "scenario", "script", "cycles", "budget"
+    );
+    for scenario in scenarios() {
+        let name = scenario.name();
+        let (data_loader, rtx) = scenario.build();
+        let verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
+        let total_cycles = verifier
+            .verify(MAX_CYCLES)
+            .unwrap_or_else(|err| panic!("{} verification failed: {:?}", name, err));
+        for (script, cycles) in script_group_cycles(&rtx, &data_loader) {
+            let budget = budgets.get(&(name.clone(), script.to_string())).cloned();
+            println!(
+                "{:<28} {:<16} {:>14} {:>14}",
+                name,
+                script,
+                cycles,
+                budget
+                    .map(|budget| budget.to_string())
+                    .unwrap_or_else(|| "-".to_string())
+            );
+            match budget {
+                Some(budget) if cycles > budget => {
+                    exceeded.push(format!("{} {} {} > {}", name, script, cycles, budget))
+                }
+                Some(_) => {}
+                None => missing.push(format!("{} {}", name, script)),
+            }
+            report.push((name.clone(), script, cycles));
+        }
+        println!("{:<28} {:<16} {:>14}", name, "total", total_cycles);
+    }
+    if let Ok(path) = env::var(REPORT_ENV) {
+        let content: String = report
+            .iter()
+            .map(|(name, script, cycles)| format!("{} {} {}\n", name, script, cycles))
+            .collect();
+        fs::write(path, content).expect("write report");
+    }
+    if update {
+        write_budgets(&report);
+        return;
+    }
+    if env::var(REQUIRE_BUDGETS_ENV).is_ok() {
+        assert!(
+            missing.is_empty(),
+            "no cycle budgets, run `make bench-update`:\n{}",
+            missing.join("\n")
+        );
+    } else if !missing.is_empty() {
+        println!(
+            "no cycle budgets, run `make bench-update`:\n{}",
+            missing.join("\n")
+        );
+    }
+    assert!(
+        exceeded.is_empty(),
+        "cycle budgets exceeded:\n{}",
+        exceeded.join("\n")
+    );
+}
+
+#[test]
+fn bench_phases() {
+    if env::var(PHASES_ENV).is_err() {
+        return;
+    }
+    for scenario in scenarios() {
+        let (data_loader, rtx) = scenario.build();
+        let (_, markers) = verify_with_markers(&rtx, &data_loader, None, MAX_CYCLES);
+        print_phase_table(&scenario.name(), &rtx, &data_loader, &markers);
+    }
+}
+
+// ckb-debugger mock transaction of a resolved transaction
+fn mock_tx(rtx: &ResolvedTransaction, data_loader: &DummyDataLoader) -> serde_json::Value {
+    let cell = |meta: &CellMeta| {
+        let (data, _) = data_loader.load_cell_data(meta).expect("cell data");
+        let header: Option<H256> = meta
+            .transaction_info
+            .as_ref()
+            .map(|info| info.block_hash.unpack());
+        (
+            json::CellOutput::from(meta.cell_output.clone()),
+            json::JsonBytes::from_bytes(data),
+            header,
+        )
+    };
+    let tx = &rtx.transaction;
+    let inputs: Vec<_> = tx
+        .inputs()
+        .into_iter()
+        .zip(&rtx.resolved_inputs)
+        .map(|(input, meta)| {
+            let (output, data, header) = cell(meta);
+            json!({
+                "input": json::CellInput::from(input),
+                "output": output,
+                "data": data,
+                "header": header,
+            })
+        })
+        .collect();
+    let cell_deps: Vec<_> = tx
+        .cell_deps()
+        .into_iter()
+        .map(|cell_dep| {
+            let meta = rtx
+                .resolved_cell_deps
+                .iter()
+                .find(|meta| meta.out_point == cell_dep.out_point())
+                .expect("resolved cell dep");
+            let (output, data, header) = cell(meta);
+            json!({
+                "cell_dep": json::CellDep::from(cell_dep),
+                "output": output,
+                "data": data,
+                "header": header,
+            })
+        })
+        .collect();
+    let header_deps: Vec<_> = tx
+        .header_deps()
+        .into_iter()
+        .map(|hash| json::HeaderView::from(data_loader.get_header(&hash).expect("header dep")))
+        .collect();
+    json!({
+        "mock_info": {
+            "inputs": inputs,
+            "cell_deps": cell_deps,
+            "header_deps": header_deps,
+        },
+        "tx": json::Transaction::from(tx.data()),
+    })
+}
+
+// DCKB script groups as (script, group type, cell type, index of the first
+// cell), the arguments ckb-debugger takes to run a group
+fn script_groups(
+    rtx: &ResolvedTransaction,
+) -> Vec<(&'static str, &'static str, &'static str, usize)> {
+    let names = script_names(rtx);
+    let inputs = rtx
+        .resolved_inputs
+        .iter()
+        .enumerate()
+        .flat_map(|(i, cell)| {
+            let output = &cell.cell_output;
+            vec![
+                ("lock", "input", i, Some(output.lock())),
+                ("type", "input", i, output.type_().to_opt()),
+            ]
+        });
+    let outputs = rtx
+        .transaction
+        .outputs()
+        .into_iter()
+        .enumerate()
+        .map(|(i, output)| ("type", "output", i, output.type_().to_opt()));
+    let mut seen = HashSet::new();
+    let mut groups = Vec::new();
+    for (group_type, cell_type, i, script) in inputs.chain(outputs) {
+        let hash = match script {
+            Some(script) => script.calc_script_hash(),
+            None => continue,
+        };
+        if let Some(name) = names.get(&hash) {
+            if seen.insert(hash) {
+                groups.push((*name, group_type, cell_type, i));
+            }
+        }
+    }
+    groups
+}
+
+// writes <scenario>.json and <scenario>.groups for `make flamegraph`
+#[test]
+fn bench_mock_tx() {
+    let name = match env::var(MOCK_TX_ENV) {
+        Ok(name) => name,
+        Err(_) => return,
+    };
+    let dir = env::var(MOCK_TX_DIR_ENV).unwrap_or_else(|_| ".".to_string());
+    let scenario = scenarios()
+        .into_iter()
+        .find(|scenario| scenario.name() == name)
+        .unwrap_or_else(|| panic!("unknown scenario {}", name));
+    let (data_loader, rtx) = scenario.build();
+    let content = serde_json::to_string_pretty(&mock_tx(&rtx, &data_loader)).expect("json");
+    fs::write(format!("{}/{}.json", dir, name), content).expect("write mock tx");
+    let groups: String = script_groups(&rtx)
+        .into_iter()
+        .map(|(script, group_type, cell_type, i)| {
+            format!("{} {} {} {}\n", script, group_type, cell_type, i)
+        })
+        .collect();
+    fs::write(format!("{}/{}.groups", dir, name), groups).expect("write groups");
+}
+
+#[test]
+fn bench_record_corpus() {
+    let path = match env::var(CORPUS_RECORD_ENV) {
+        Ok(path) => path,
+        Err(_) => return,
+    };
+    let mut corpus = String::new();
+    for scenario in scenarios() {
+        let (data_loader, rtx) = scenario.build();
+        let mut record = mock_tx(&rtx, &data_loader);
+        let outcome = Outcome::verify(&rtx, &data_loader);
+        record["result"] = serde_json::to_value(outcome).expect("json");
+        corpus.push_str(&serde_json::to_string(&record).expect("json"));
+        corpus.push('\n');
+    }
+    fs::write(path, corpus).expect("write corpus");
+}
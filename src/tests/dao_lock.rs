@@ -1,11 +1,12 @@
 use super::*;
 use byteorder::{ByteOrder, LittleEndian};
-use ckb_script::TransactionScriptsVerifier;
+use ckb_error::Error;
+use ckb_script::ScriptGroupType;
 use ckb_types::{
     bytes::Bytes,
     core::{
         cell::{CellMetaBuilder, ResolvedTransaction},
-        Capacity, EpochNumberWithFraction, TransactionBuilder, TransactionInfo,
+        Capacity, Cycle, EpochNumberWithFraction, TransactionBuilder, TransactionInfo,
     },
     packed::{CellInput, WitnessArgs},
     prelude::*,
@@ -133,14 +134,371 @@ fn test_dao_lock_phase1_unlock() {
         resolved_dep_groups: vec![],
     };
 
-    let mut verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
-    verifier.set_debug_printer(|_hash, msg| println!("msg {}", msg));
-    let verify_result = verifier.verify(MAX_CYCLES);
+    let verify_result = verify_tx(&rtx, &data_loader);
     verify_result.expect("pass verification");
 }
 
+#[test]
+fn test_dao_lock_phase1_unlock_shared_custodian() {
+    verify_phase1_custodians(false, 0).expect("pass verification");
+    // custodian cell must cover both groups
+    assert_error_code(
+        verify_phase1_custodians(false, 1),
+        ERROR_DL_INCORRECT_DESTROY_AMOUNT,
+    );
+}
+
+#[test]
+fn test_dao_lock_phase1_unlock_separate_custodians() {
+    verify_phase1_custodians(true, 0).expect("pass verification");
+    // each custodian cell must cover its group
+    assert_error_code(
+        verify_phase1_custodians(true, 1),
+        ERROR_DL_INCORRECT_DESTROY_AMOUNT,
+    );
+}
+
+// two DAO lock groups of different refund locks withdrawn in one tx, the
+// custodian cells have the DCKB of both groups minus custodian_shortage of the
+// last one. The groups share one custodian cell, or each points to its own if
+// separate_custodians.
+fn verify_phase1_custodians(
+    separate_custodians: bool,
+    custodian_shortage: u64,
+) -> Result<Cycle, Error> {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let (_, other_lock_args) = gen_lock();
+
+    let (deposit_header, deposit_epoch) = gen_header(1554, 10000000, 35, 1000, 1000);
+    let (withdraw_header, withdraw_epoch) = gen_header(2000610, 10001000, 575, 2000000, 1100);
+
+    // inputs cells, a DAO cell for each refund lock
+    let original_dao_capacities = [123456780000u64, 200000000000u64];
+    let refund_locks = [
+        gen_secp256k1_lock_script(lock_args.clone()),
+        gen_secp256k1_lock_script(other_lock_args),
+    ];
+    let mut dao_cells = Vec::new();
+    for (capacity, refund_lock) in original_dao_capacities.iter().zip(refund_locks.iter()) {
+        let dao_lock_script = gen_dao_lock_lock_script(refund_lock.calc_script_hash().unpack());
+        dao_cells.push(gen_dao_cell(
+            &mut data_loader,
+            Capacity::shannons(*capacity),
+            dao_lock_script,
+        ));
+    }
+    let custodian_amount: u64 = original_dao_capacities
+        .iter()
+        .map(|capacity| capacity - DAO_OCCUPIED_CAPACITY)
+        .sum();
+    let input_dckb_amount = 400000000000u64;
+    let (dckb_cell, dckb_previous_out_point, dckb_cell_data) =
+        gen_dckb_cell(&mut data_loader, input_dckb_amount, 0, lock_args.clone());
+    let (fee_input_cell, fee_input_out_point) = gen_normal_cell(
+        &mut data_loader,
+        Capacity::shannons(SECP_OCCUPIED_CAPACITY),
+        lock_args.clone(),
+    );
+    // outputs cells
+    let custodian_cell = CellOutput::new_builder()
+        .capacity(Capacity::shannons(SECP_OCCUPIED_CAPACITY).pack())
+        .lock(gen_custodian_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    let custodian_amounts = if separate_custodians {
+        original_dao_capacities
+            .iter()
+            .map(|capacity| capacity - DAO_OCCUPIED_CAPACITY)
+            .collect()
+    } else {
+        vec![custodian_amount]
+    };
+    let dckb_change_cell = CellOutput::new_builder()
+        .capacity(DCKB_CAPACITY.pack())
+        .lock(gen_secp256k1_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    let dckb_change_data = dckb_data(
+        (input_dckb_amount - custodian_amount + custodian_shortage).into(),
+        1554,
+    );
+
+    data_loader
+        .headers
+        .insert(deposit_header.hash(), deposit_header.clone());
+    data_loader
+        .headers
+        .insert(withdraw_header.hash(), withdraw_header.clone());
+    data_loader
+        .epoches
+        .insert(deposit_header.hash(), deposit_epoch.clone());
+    data_loader
+        .epoches
+        .insert(withdraw_header.hash(), withdraw_epoch.clone());
+    // construct inputs cell meta info
+    let b = [0; 8];
+    let mut resolved_inputs = Vec::new();
+    for (cell, previous_out_point) in dao_cells.iter() {
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell.clone(), Bytes::from(&b[..]))
+                .out_point(previous_out_point.clone())
+                .transaction_info(TransactionInfo {
+                    block_hash: deposit_header.hash(),
+                    block_number: deposit_header.number(),
+                    block_epoch: deposit_epoch.number_with_fraction(deposit_header.number()),
+                    index: 0,
+                })
+                .build(),
+        );
+    }
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(dckb_cell, Bytes::from(&dckb_cell_data[..]))
+            .out_point(dckb_previous_out_point.clone())
+            .transaction_info(TransactionInfo {
+                block_hash: deposit_header.hash(),
+                block_number: deposit_header.number(),
+                block_epoch: EpochNumberWithFraction::new(575, 610, 1100),
+                index: 0,
+            })
+            .build(),
+    );
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(fee_input_cell, Bytes::new())
+            .out_point(fee_input_out_point.clone())
+            .build(),
+    );
+    let mut resolved_cell_deps = vec![];
+
+    // the custodian cells follow the withdrawing cells, both groups point to
+    // the first one unless separate_custodians
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(deposit_header.number().to_le_bytes().to_vec()).pack())
+        .build();
+    let mut builder = TransactionBuilder::default();
+    for (i, (cell, previous_out_point)) in dao_cells.iter().enumerate() {
+        let custodian_cell_index = (if separate_custodians { 2 + i } else { 2 }) as u8;
+        let witness = WitnessArgs::new_builder()
+            .lock(Bytes::from(vec![custodian_cell_index]).pack())
+            .type_(Bytes::from(&0u8.to_le_bytes()[..]).pack())
+            .build();
+        let dao_withdraw_cell_data: Bytes = 1554u64.to_le_bytes().to_vec().into();
+        builder = builder
+            .input(CellInput::new(previous_out_point.clone(), 0))
+            .output(cell.clone())
+            .output_data(dao_withdraw_cell_data.pack())
+            .witness(witness.as_bytes().pack());
+    }
+    for (i, amount) in custodian_amounts.iter().enumerate() {
+        let mut amount = *amount;
+        if i == custodian_amounts.len() - 1 {
+            amount -= custodian_shortage;
+        }
+        builder = builder
+            .output(custodian_cell.clone())
+            .output_data(dckb_data(amount.into(), 1554).pack());
+    }
+    let builder = builder
+        .input(CellInput::new(dckb_previous_out_point, 0))
+        .input(CellInput::new(fee_input_out_point, 0))
+        .output(dckb_change_cell)
+        .output_data(dckb_change_data.pack())
+        .header_dep(deposit_header.hash())
+        .header_dep(withdraw_header.hash())
+        .witness(dckb_witness.as_bytes().pack());
+    let (tx, mut resolved_cell_deps2) = complete_tx(&mut data_loader, builder);
+    let tx = sign_tx_by_input_group(tx, &privkey, 2, 2);
+    for dep in resolved_cell_deps2.drain(..) {
+        resolved_cell_deps.push(dep);
+    }
+    let rtx = ResolvedTransaction {
+        transaction: tx,
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    };
+
+    verify_tx(&rtx, &data_loader)
+}
+
 #[test]
 fn test_dao_lock_phase2_unlock() {
+    let custodian_cell_index: u8 = 2;
+    verify_phase2_unlock(vec![custodian_cell_index], None).expect("pass verification");
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_packed_header_indexes() {
+    // custodian index then the deposit header index of each group input
+    let custodian_cell_index: u8 = 2;
+    let deposit_header_index: u8 = 1;
+    verify_phase2_unlock(vec![custodian_cell_index, deposit_header_index], None)
+        .expect("pass verification");
+    // packed index points to the withdraw header
+    assert_error_code(
+        verify_phase2_unlock(vec![custodian_cell_index, 0], None),
+        ERROR_INVALID_WITHDRAW_BLOCK,
+    );
+    // packed index out of the header deps
+    assert_error_code(
+        verify_phase2_unlock(vec![custodian_cell_index, 2], None),
+        ERROR_LOAD_HEADER,
+    );
+    // an index for each group input, not more
+    let witness_lock = vec![
+        custodian_cell_index,
+        deposit_header_index,
+        deposit_header_index,
+    ];
+    assert_error_code(
+        verify_phase2_unlock(witness_lock, None),
+        ERROR_DL_NO_CUSTODIAN_CELL_INDEX,
+    );
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_witness_exceeds_arena() {
+    // the witness lock is copied to the arena, ARENA_SIZE in c/arena.h
+    let custodian_cell_index: u8 = 2;
+    let mut witness_lock = vec![0u8; 512 * 1024 + 1];
+    witness_lock[0] = custodian_cell_index;
+    let (rtx, data_loader) = phase2_unlock_tx(witness_lock, None, 0);
+    let dao_lock = dao_lock_script(&rtx);
+    assert_error_code(
+        verify_group(&rtx, &data_loader, ScriptGroupType::Lock, dao_lock),
+        ERROR_ARENA_EXHAUSTED,
+    );
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_committed_destroy_amount() {
+    let custodian_cell_index: u8 = 2;
+    verify_phase2_unlock(vec![custodian_cell_index], Some(0)).expect("pass verification");
+    // a wrong committed amount, DCKB rejects it and so does dao_lock
+    let (rtx, data_loader) = phase2_unlock_tx(vec![custodian_cell_index], Some(1), 0);
+    let dao_lock = dao_lock_script(&rtx);
+    assert_error_code(
+        verify_group(&rtx, &data_loader, ScriptGroupType::Type, dckb_script()),
+        ERROR_DCKB_DESTROY_AMOUNT,
+    );
+    assert_error_code(
+        verify_group(&rtx, &data_loader, ScriptGroupType::Lock, dao_lock),
+        ERROR_DL_INCORRECT_DESTROY_AMOUNT,
+    );
+    // one DCKB less is destroyed than committed, dao_lock takes the committed
+    // amount without aligning the inputs again, DCKB rejects it
+    let (rtx, data_loader) = phase2_unlock_tx(vec![custodian_cell_index], Some(0), 1);
+    let dao_lock = dao_lock_script(&rtx);
+    verify_group(&rtx, &data_loader, ScriptGroupType::Lock, dao_lock).expect("pass verification");
+    assert_error_code(
+        verify_group(&rtx, &data_loader, ScriptGroupType::Type, dckb_script()),
+        ERROR_DCKB_DESTROY_AMOUNT,
+    );
+}
+
+#[test]
+fn test_dao_lock_args_len() {
+    // dao_lock takes exactly 64 bytes args
+    for &args_len in &[32, 63, 65] {
+        let (mut rtx, data_loader) = phase2_unlock_tx(vec![2], None, 0);
+        resize_input_lock_args(&mut rtx, 0, args_len);
+        let dao_lock = dao_lock_script(&rtx);
+        assert_error_code(
+            verify_group(&rtx, &data_loader, ScriptGroupType::Lock, dao_lock),
+            ERROR_ENCODING,
+        );
+    }
+}
+
+#[test]
+fn test_custodian_lock_args_len() {
+    // custodian_lock takes exactly 32 bytes args, the custodian cell is input 2
+    let custodian_cell_index = 2;
+    for &args_len in &[0, 31, 33, 64] {
+        let (mut rtx, data_loader) = phase2_unlock_tx(vec![custodian_cell_index as u8], None, 0);
+        resize_input_lock_args(&mut rtx, custodian_cell_index, args_len);
+        let custodian_lock = rtx.resolved_inputs[custodian_cell_index].cell_output.lock();
+        assert_error_code(
+            verify_group(&rtx, &data_loader, ScriptGroupType::Lock, custodian_lock),
+            ERROR_ENCODING,
+        );
+    }
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_interleaved_heights() {
+    // DCKB inputs of interleaved deposit heights, each is aligned alone
+    let extra_inputs = [(333333333, 1554), (444444444, 2000610), (555555555, 1554)];
+    let verify = |change_error| {
+        let (rtx, data_loader) = phase2_unlock_more_dckb_tx(&extra_inputs, change_error);
+        let dao_lock = dao_lock_script(&rtx);
+        verify_group(&rtx, &data_loader, ScriptGroupType::Lock, dao_lock)
+    };
+    verify(0).expect("pass verification");
+    assert_error_code(verify(1), ERROR_DL_INCORRECT_DESTROY_AMOUNT);
+}
+
+// phase2_unlock_tx with more DCKB inputs of (amount, deposit height), the DCKB
+// change takes their aligned amounts plus change_error. The lock of the DCKB
+// inputs is not signed again, only DCKB and dao_lock groups pass
+fn phase2_unlock_more_dckb_tx(
+    extra_inputs: &[(u64, u64)],
+    change_error: u64,
+) -> (ResolvedTransaction, DummyDataLoader) {
+    let (rtx, mut data_loader) = phase2_unlock_tx(vec![2], None, 0);
+    let lock_args = rtx.resolved_inputs[1].cell_output.lock().args().raw_data();
+    let mut builder = rtx.transaction.as_advanced_builder();
+    let mut resolved_inputs = rtx.resolved_inputs.clone();
+    let mut outputs_data: Vec<_> = rtx.transaction.outputs_data().into_iter().collect();
+    let mut change = [0u8; 16];
+    change.copy_from_slice(&outputs_data[1].raw_data()[..16]);
+    let mut change = u128::from_le_bytes(change) + u128::from(change_error);
+    for &(amount, height) in extra_inputs {
+        let (cell, out_point, data) =
+            gen_dckb_cell(&mut data_loader, amount, height, lock_args.clone());
+        builder = builder.input(CellInput::new(out_point.clone(), 0));
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell, data)
+                .out_point(out_point)
+                .build(),
+        );
+        // deposit ar 10000000, withdraw ar 10001000, see phase2_unlock_tx
+        change += match height {
+            1554 => u128::from(amount) * 10001000 / 10000000,
+            _ => u128::from(amount),
+        };
+    }
+    outputs_data[1] = dckb_data(change, 2000610).pack();
+    let rtx = ResolvedTransaction {
+        transaction: builder.set_outputs_data(outputs_data).build(),
+        resolved_inputs,
+        ..rtx
+    };
+    (rtx, data_loader)
+}
+
+// lock of the first input
+pub(super) fn dao_lock_script(rtx: &ResolvedTransaction) -> Script {
+    rtx.resolved_inputs[0].cell_output.lock()
+}
+
+fn verify_phase2_unlock(
+    dao_lock_witness_lock: Vec<u8>,
+    destroy_amount_error: Option<u64>,
+) -> Result<Cycle, Error> {
+    let (rtx, data_loader) = phase2_unlock_tx(dao_lock_witness_lock, destroy_amount_error, 0);
+    verify_tx(&rtx, &data_loader)
+}
+
+// dao_lock_witness_lock is the witness lock of the DAO input,
+// destroy_amount_error: if set, commit the destroyed DCKB plus this error in
+// the witness of the DCKB output
+// destroy_shortage: DCKB destroyed less than the withdraw capacity
+pub(super) fn phase2_unlock_tx(
+    dao_lock_witness_lock: Vec<u8>,
+    destroy_amount_error: Option<u64>,
+    destroy_shortage: u64,
+) -> (ResolvedTransaction, DummyDataLoader) {
     let mut data_loader = DummyDataLoader::new();
     let (privkey, lock_args) = gen_lock();
 
@@ -164,7 +522,9 @@ fn test_dao_lock_phase2_unlock() {
         Capacity::shannons(original_dao_capacity),
         dao_lock_script,
     );
-    let input_dckb_amount = 100000000u64;
+    // the custodian cell has the DCKB custodied in phase1
+    let custodian_amount = original_dao_capacity - DAO_OCCUPIED_CAPACITY;
+    let input_dckb_amount = DAO_OCCUPIED_CAPACITY + 100000000u64;
     let (dckb_cell, dckb_previous_out_point, dckb_cell_data) =
         gen_dckb_cell(&mut data_loader, input_dckb_amount, 0, lock_args.clone());
     let (custodian_cell, custodian_cell_out_point, custodian_cell_data) = {
@@ -175,7 +535,7 @@ fn test_dao_lock_phase2_unlock() {
             .build();
         let (custodian_cell, custodian_cell_data) = gen_custodian_cell(
             &mut data_loader,
-            original_dao_capacity,
+            custodian_amount,
             withdraw_header.number(),
             lock_args.clone(),
             out_point.clone(),
@@ -190,7 +550,8 @@ fn test_dao_lock_phase2_unlock() {
         .type_(Some(dckb_script()).pack())
         .build();
     let dckb_change_data = dckb_data(
-        (input_dckb_amount + original_dao_capacity - expected_withdraw_caapcity).into(),
+        (input_dckb_amount + custodian_amount - expected_withdraw_caapcity + destroy_shortage)
+            .into(),
         withdraw_header.number(),
     );
     let withdraw_cell =
@@ -253,15 +614,20 @@ fn test_dao_lock_phase2_unlock() {
 
     let mut b = [0; 8];
     LittleEndian::write_u64(&mut b, 1);
-    let custodian_cell_index: u8 = 2;
     let witness = WitnessArgs::new_builder()
-        .lock(Bytes::from(vec![custodian_cell_index]).pack())
+        .lock(Bytes::from(dao_lock_witness_lock).pack())
         .type_(Bytes::from(&1u64.to_le_bytes()[..]).pack())
         .build();
     let align_target_block_number: u64 = withdraw_header.number();
-    let dckb_witness = WitnessArgs::new_builder()
-        .type_(Bytes::from(align_target_block_number.to_le_bytes().to_vec()).pack())
-        .build();
+    let mut dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(align_target_block_number.to_le_bytes().to_vec()).pack());
+    if let Some(error) = destroy_amount_error {
+        // the DCKB output is output 1, destroyed DCKB equals to the withdraw capacity
+        let destroy_amount = expected_withdraw_caapcity + error;
+        dckb_witness = dckb_witness
+            .output_type(Bytes::from(destroy_amount.to_le_bytes().to_vec()).pack());
+    }
+    let dckb_witness = dckb_witness.build();
     let unlock_input_cell_index: u8 = 1;
     let custodian_cell_witness = WitnessArgs::new_builder()
         .lock(Bytes::from(vec![unlock_input_cell_index]).pack())
@@ -292,8 +658,221 @@ fn test_dao_lock_phase2_unlock() {
         resolved_dep_groups: vec![],
     };
 
-    let mut verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
-    verifier.set_debug_printer(|_hash, msg| println!("msg {}", msg));
-    let verify_result = verifier.verify(MAX_CYCLES);
-    verify_result.expect("pass verification");
+    (rtx, data_loader)
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_shared_custodian() {
+    verify_phase2_dao_cells(false, 2, 0).expect("pass verification");
+    // the custodian cell backs both groups, neither unlocks it alone
+    assert_error_code(
+        verify_phase2_dao_cells(false, 1, 0),
+        ERROR_DL_INCOMPLETE_BATCH,
+    );
+}
+
+#[test]
+fn test_dao_lock_phase2_unlock_summed_compensation() {
+    verify_phase2_dao_cells(true, 2, 0).expect("pass verification");
+    // the group destroys the withdraw capacity of every cell, not only the
+    // last one
+    let first_cell_capacity = {
+        let (deposit_header, _) = gen_header(1554, 10000000, 35, 1000, 1000);
+        let (withdraw_header, _) = gen_header(2000610, 10001000, 575, 2000000, 1100);
+        calculate_dao_capacity(
+            DAO_OCCUPIED_CAPACITY,
+            &deposit_header,
+            &withdraw_header,
+            123456780000u64,
+        )
+    };
+    assert_error_code(
+        verify_phase2_dao_cells(true, 2, first_cell_capacity),
+        ERROR_DL_INCORRECT_DESTROY_AMOUNT,
+    );
+}
+
+// two DAO cells withdrawn in one phase1 tx with a custodian cell for both,
+// the first dao_cells_cnt of them unlock with it. The cells are of one group
+// if same_refund_lock, otherwise of two groups of different refund locks.
+// destroy_shortage: DCKB destroyed less than the withdraw capacity
+fn verify_phase2_dao_cells(
+    same_refund_lock: bool,
+    dao_cells_cnt: usize,
+    destroy_shortage: u64,
+) -> Result<Cycle, Error> {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let other_lock_args = if same_refund_lock {
+        lock_args.clone()
+    } else {
+        gen_lock().1
+    };
+
+    let (deposit_header, deposit_epoch) = gen_header(1554, 10000000, 35, 1000, 1000);
+    let (withdraw_header, withdraw_epoch) = gen_header(2000610, 10001000, 575, 2000000, 1100);
+    // inputs, the DAO cells and the custodian cell are from the phase1 tx
+    let original_dao_capacities = [123456780000u64, 200000000000u64];
+    let refund_locks = [
+        gen_secp256k1_lock_script(lock_args.clone()),
+        gen_secp256k1_lock_script(other_lock_args),
+    ];
+    let phase1_tx_hash = generate_random_out_point().tx_hash();
+    let mut dao_cells = Vec::new();
+    for (i, (capacity, refund_lock)) in original_dao_capacities
+        .iter()
+        .zip(refund_locks.iter())
+        .enumerate()
+    {
+        let (cell, _) = gen_dao_cell(
+            &mut data_loader,
+            Capacity::shannons(*capacity),
+            gen_dao_lock_lock_script(refund_lock.calc_script_hash().unpack()),
+        );
+        let out_point = OutPoint::new_builder()
+            .tx_hash(phase1_tx_hash.clone())
+            .index((i as u32).pack())
+            .build();
+        data_loader
+            .cells
+            .insert(out_point.clone(), (cell.clone(), Bytes::new()));
+        dao_cells.push((cell, out_point));
+    }
+    let custodian_amount: u64 = original_dao_capacities
+        .iter()
+        .map(|capacity| capacity - DAO_OCCUPIED_CAPACITY)
+        .sum();
+    let destroy_amount: u64 = original_dao_capacities[..dao_cells_cnt]
+        .iter()
+        .map(|capacity| {
+            calculate_dao_capacity(
+                DAO_OCCUPIED_CAPACITY,
+                &deposit_header,
+                &withdraw_header,
+                *capacity,
+            )
+        })
+        .sum::<u64>()
+        - destroy_shortage;
+    let input_dckb_amount = 2 * DAO_OCCUPIED_CAPACITY + 100000000u64;
+    let (dckb_cell, dckb_previous_out_point, dckb_cell_data) =
+        gen_dckb_cell(&mut data_loader, input_dckb_amount, 0, lock_args.clone());
+    let custodian_cell_out_point = OutPoint::new_builder()
+        .tx_hash(phase1_tx_hash)
+        .index(2u32.pack())
+        .build();
+    let (custodian_cell, custodian_cell_data) = gen_custodian_cell(
+        &mut data_loader,
+        custodian_amount,
+        withdraw_header.number(),
+        lock_args.clone(),
+        custodian_cell_out_point.clone(),
+    );
+
+    data_loader
+        .headers
+        .insert(deposit_header.hash(), deposit_header.clone());
+    data_loader
+        .headers
+        .insert(withdraw_header.hash(), withdraw_header.clone());
+    data_loader
+        .epoches
+        .insert(deposit_header.hash(), deposit_epoch.clone());
+    data_loader
+        .epoches
+        .insert(withdraw_header.hash(), withdraw_epoch.clone());
+
+    let transaction_info = TransactionInfo {
+        block_hash: withdraw_header.hash(),
+        block_number: withdraw_header.number(),
+        block_epoch: EpochNumberWithFraction::new(575, 610, 1100),
+        index: 0,
+    };
+    let mut b = [0; 8];
+    LittleEndian::write_u64(&mut b, 1554);
+    let mut resolved_inputs = Vec::new();
+    for (cell, out_point) in dao_cells[..dao_cells_cnt].iter() {
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell.clone(), Bytes::from(&b[..]))
+                .out_point(out_point.clone())
+                .transaction_info(transaction_info.clone())
+                .build(),
+        );
+    }
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(dckb_cell, Bytes::from(&dckb_cell_data[..]))
+            .out_point(dckb_previous_out_point.clone())
+            .transaction_info(transaction_info.clone())
+            .build(),
+    );
+    resolved_inputs.push(
+        CellMetaBuilder::from_cell_output(custodian_cell, custodian_cell_data)
+            .out_point(custodian_cell_out_point.clone())
+            .transaction_info(transaction_info)
+            .build(),
+    );
+    let mut resolved_cell_deps = vec![];
+
+    // the custodian cell follows the DAO cells and the DCKB cell
+    let custodian_cell_index = dao_cells_cnt as u8 + 1;
+    let witness = WitnessArgs::new_builder()
+        .lock(Bytes::from(vec![custodian_cell_index]).pack())
+        .type_(Bytes::from(&1u64.to_le_bytes()[..]).pack())
+        .build();
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(withdraw_header.number().to_le_bytes().to_vec()).pack())
+        .build();
+    let unlock_input_cell_index = dao_cells_cnt as u8;
+    let custodian_cell_witness = WitnessArgs::new_builder()
+        .lock(Bytes::from(vec![unlock_input_cell_index]).pack())
+        .type_(Bytes::from(vec![0]).pack())
+        .build();
+    let mut builder = TransactionBuilder::default();
+    for (i, (cell, out_point)) in dao_cells[..dao_cells_cnt].iter().enumerate() {
+        // the DCKB change cell refunds its capacity to the first refund lock
+        let mut refund_capacity = original_dao_capacities[i];
+        if i == 0 {
+            refund_capacity -= DCKB_CAPACITY.as_u64();
+        }
+        let refund_cell = cell_output_with_only_capacity(refund_capacity)
+            .as_builder()
+            .lock(refund_locks[i].clone())
+            .build();
+        builder = builder
+            .input(CellInput::new(out_point.clone(), 0x2003e8022a0002f3))
+            .output(refund_cell)
+            .output_data(Bytes::new().pack())
+            .witness(witness.as_bytes().pack());
+    }
+    let dckb_change_cell = CellOutput::new_builder()
+        .capacity(DCKB_CAPACITY.pack())
+        .lock(gen_secp256k1_lock_script(lock_args.clone()))
+        .type_(Some(dckb_script()).pack())
+        .build();
+    let dckb_change_data = dckb_data(
+        (input_dckb_amount + custodian_amount - destroy_amount).into(),
+        withdraw_header.number(),
+    );
+    let builder = builder
+        .input(CellInput::new(dckb_previous_out_point, 0))
+        .input(CellInput::new(custodian_cell_out_point, 0))
+        .output(dckb_change_cell)
+        .output_data(dckb_change_data.pack())
+        .header_dep(withdraw_header.hash())
+        .header_dep(deposit_header.hash())
+        .witness(dckb_witness.as_bytes().pack())
+        .witness(custodian_cell_witness.as_bytes().pack());
+    let (tx, mut resolved_cell_deps2) = complete_tx(&mut data_loader, builder);
+    let tx = sign_tx_by_input_group(tx, &privkey, dao_cells_cnt, 1);
+    for dep in resolved_cell_deps2.drain(..) {
+        resolved_cell_deps.push(dep);
+    }
+    let rtx = ResolvedTransaction {
+        transaction: tx,
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    };
+
+    verify_tx(&rtx, &data_loader)
 }
@@ -1,6 +1,5 @@
 use super::*;
 use byteorder::{ByteOrder, LittleEndian};
-use ckb_script::TransactionScriptsVerifier;
 use ckb_types::{
     bytes::Bytes,
     core::{
@@ -94,9 +93,7 @@ fn test_dckb_withdraw() {
         resolved_dep_groups: vec![],
     };
 
-    let mut verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
-    verifier.set_debug_printer(|_hash, msg| println!("msg {}", msg));
-    let verify_result = verifier.verify(MAX_CYCLES);
+    let verify_result = verify_tx(&rtx, &data_loader);
     verify_result.expect("pass verification");
 }
 
@@ -188,9 +185,7 @@ fn test_dckb_transfer() {
         resolved_dep_groups: vec![],
     };
 
-    let mut verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
-    verifier.set_debug_printer(|_hash, msg| println!("msg {}", msg));
-    let verify_result = verifier.verify(MAX_CYCLES);
+    let verify_result = verify_tx(&rtx, &data_loader);
     verify_result.expect("pass verification");
 }
 
@@ -274,8 +269,328 @@ fn test_dckb_deposit() {
         resolved_dep_groups: vec![],
     };
 
-    let mut verifier = TransactionScriptsVerifier::new(&rtx, &data_loader);
-    verifier.set_debug_printer(|_hash, msg| println!("msg {}", msg));
-    let verify_result = verifier.verify(MAX_CYCLES);
+    let verify_result = verify_tx(&rtx, &data_loader);
     verify_result.expect("pass verification");
 }
+
+// transfer one DCKB cell aligned from header1 to header2, output `output_coin`,
+// `header_hints` follows the align target number in the witness
+fn align_transfer_verify(
+    ar1: u64,
+    ar2: u64,
+    input_coin: u64,
+    output_coin: u64,
+    header_hints: &[u8],
+) -> Result<Cycle, Error> {
+    let (rtx, data_loader) = align_transfer_tx(ar1, ar2, input_coin, output_coin, header_hints);
+    verify_tx(&rtx, &data_loader)
+}
+
+pub(super) fn align_transfer_tx(
+    ar1: u64,
+    ar2: u64,
+    input_coin: u64,
+    output_coin: u64,
+    header_hints: &[u8],
+) -> (ResolvedTransaction, DummyDataLoader) {
+    let data: fn(u64, u64) -> Bytes = |ckb, block_number| dckb_data(ckb.into(), block_number);
+    align_transfer_data_tx(
+        ar1,
+        ar2,
+        input_coin,
+        output_coin,
+        header_hints,
+        &[data],
+        &[data],
+    )
+}
+
+// align_transfer_tx of a DCKB input for each of input_data and an output for
+// each of output_data, their DCKB data are encoded by those
+fn align_transfer_data_tx(
+    ar1: u64,
+    ar2: u64,
+    input_coin: u64,
+    output_coin: u64,
+    header_hints: &[u8],
+    input_data: &[fn(u64, u64) -> Bytes],
+    output_data: &[fn(u64, u64) -> Bytes],
+) -> (ResolvedTransaction, DummyDataLoader) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+
+    let (header1, header1_epoch) = gen_header(1554, ar1, 35, 1000, 1000);
+    let (header2, header2_epoch) = gen_header(2000610, ar2, 575, 2000000, 1100);
+    for (header, epoch) in vec![(&header1, header1_epoch), (&header2, header2_epoch)] {
+        data_loader.headers.insert(header.hash(), header.clone());
+        data_loader.epoches.insert(header.hash(), epoch);
+    }
+
+    let mut input_type = header2.number().to_le_bytes().to_vec();
+    input_type.extend_from_slice(header_hints);
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(input_type).pack())
+        .build();
+    let mut builder = TransactionBuilder::default()
+        .header_dep(header1.hash())
+        .header_dep(header2.hash())
+        .witness(dckb_witness.as_bytes().pack());
+    let mut resolved_inputs = Vec::new();
+    for data in input_data {
+        let (dckb_cell, dckb_previous_out_point, _) =
+            gen_dckb_cell(&mut data_loader, input_coin, 1554, lock_args.clone());
+        let dckb_cell_data = data(input_coin, 1554);
+        data_loader.cells.insert(
+            dckb_previous_out_point.clone(),
+            (dckb_cell.clone(), dckb_cell_data.clone()),
+        );
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(dckb_cell, dckb_cell_data)
+                .out_point(dckb_previous_out_point.clone())
+                .transaction_info(TransactionInfo {
+                    block_hash: header1.hash(),
+                    block_number: header1.number(),
+                    block_epoch: EpochNumberWithFraction::new(575, 610, 1100),
+                    index: 0,
+                })
+                .build(),
+        );
+        builder = builder.input(CellInput::new(dckb_previous_out_point, 0));
+    }
+    for data in output_data {
+        builder = builder
+            .output(dckb_cell_output())
+            .output_data(data(output_coin, header2.number()).pack());
+    }
+    let (tx, resolved_cell_deps) = complete_tx(&mut data_loader, builder);
+    let tx = sign_tx(tx, &privkey);
+    let rtx = ResolvedTransaction {
+        transaction: tx,
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    };
+    (rtx, data_loader)
+}
+
+#[test]
+fn test_dckb_align_rounding() {
+    // (deposit ar, target ar, coin), rounding is floor(coin * ar2 / ar1)
+    let cases: Vec<(u64, u64, u64)> = vec![
+        (10000000, 10001000, 100000_00000000),
+        (10000000, 10001000, 1),
+        (10000003, 10007777, 123456789),
+        (10000000000000000, 10000000000000001, 9999999999999999),
+        (10000000000000000, 13179836705385071, 333_33333333),
+        (1000, 10001000, 184467440737095),
+        (10000000, 10000000, 100000_00000000),
+    ];
+    for (ar1, ar2, coin) in cases {
+        let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+        align_transfer_verify(ar1, ar2, coin, aligned_coin, &[])
+            .unwrap_or_else(|err| panic!("exact aligned amount {:?}: {}", (ar1, ar2, coin), err));
+        // one more than the rounded down amount is an output mismatch
+        assert_error_code(
+            align_transfer_verify(ar1, ar2, coin, aligned_coin + 1, &[]),
+            ERROR_DCKB_INCORRECT_OUTPUT,
+        );
+    }
+}
+
+#[test]
+fn test_dckb_transfer_header_hints() {
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    // header deps are [header1, header2], hints are the align target index and
+    // the deposit header index of the input
+    align_transfer_verify(ar1, ar2, coin, aligned_coin, &[1, 0]).expect("pass verification");
+    assert_error_code(
+        align_transfer_verify(ar1, ar2, coin, aligned_coin + 1, &[1, 0]),
+        ERROR_DCKB_INCORRECT_OUTPUT,
+    );
+    // wrong align target header
+    assert_error_code(
+        align_transfer_verify(ar1, ar2, coin, aligned_coin, &[0, 0]),
+        ERROR_DCKB_HEADER_HINT,
+    );
+    // wrong deposit header
+    assert_error_code(
+        align_transfer_verify(ar1, ar2, coin, aligned_coin, &[1, 1]),
+        ERROR_DCKB_HEADER_HINT,
+    );
+    // deposit header index count must match input DCKB
+    assert_error_code(
+        align_transfer_verify(ar1, ar2, coin, aligned_coin, &[1]),
+        ERROR_DCKB_HEADER_HINT,
+    );
+    assert_error_code(
+        align_transfer_verify(ar1, ar2, coin, aligned_coin, &[1, 0, 0]),
+        ERROR_DCKB_HEADER_HINT,
+    );
+}
+
+#[test]
+fn test_dckb_compact_data() {
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    let verify = |output_coin, input_data, output_data| {
+        let (rtx, data_loader) = align_transfer_data_tx(
+            ar1,
+            ar2,
+            coin,
+            output_coin,
+            &[],
+            &[input_data],
+            &[output_data],
+        );
+        verify_tx(&rtx, &data_loader)
+    };
+    let data: fn(u64, u64) -> Bytes = |ckb, block_number| dckb_data(ckb.into(), block_number);
+    let compact: fn(u64, u64) -> Bytes = dckb_compact_data;
+    // unknown version
+    let version2: fn(u64, u64) -> Bytes = |ckb, block_number| {
+        let mut data = dckb_compact_data(ckb, block_number).to_vec();
+        data[0] = 2;
+        data.into()
+    };
+    // either layout in and out
+    verify(aligned_coin, compact, compact).expect("pass verification");
+    verify(aligned_coin, compact, data).expect("pass verification");
+    verify(aligned_coin, data, compact).expect("pass verification");
+    assert_error_code(
+        verify(aligned_coin + 1, compact, compact),
+        ERROR_DCKB_INCORRECT_OUTPUT,
+    );
+    assert_error_code(
+        verify(aligned_coin, version2, compact),
+        ERROR_LOAD_DCKB_DATA,
+    );
+    assert_error_code(verify(aligned_coin, data, version2), ERROR_LOAD_DCKB_DATA);
+}
+
+#[test]
+fn test_dckb_compact_data_mixed() {
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    let data: fn(u64, u64) -> Bytes = |ckb, block_number| dckb_data(ckb.into(), block_number);
+    let compact: fn(u64, u64) -> Bytes = dckb_compact_data;
+    // both layouts in the inputs and in the outputs of a transaction
+    let verify = |output_coin| {
+        let (rtx, data_loader) = align_transfer_data_tx(
+            ar1,
+            ar2,
+            coin,
+            output_coin,
+            &[],
+            &[compact, data],
+            &[data, compact],
+        );
+        verify_tx(&rtx, &data_loader)
+    };
+    verify(aligned_coin).expect("pass verification");
+    assert_error_code(verify(aligned_coin + 1), ERROR_DCKB_INCORRECT_OUTPUT);
+}
+
+#[test]
+fn test_dckb_transfer_many_header_deps() {
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    let verify = |before: usize, after: usize, missing_after: bool| {
+        let (rtx, mut data_loader) = align_transfer_tx(ar1, ar2, coin, aligned_coin, &[]);
+        let mut header_deps = noise_header_deps(&mut data_loader, before);
+        header_deps.extend(rtx.transaction.header_deps_iter());
+        header_deps.extend(noise_header_deps(&mut data_loader, after));
+        if missing_after {
+            // a header dep the data loader does not know
+            let (header, _) = gen_header(6000, 10000100, 40, 1000, 1000);
+            header_deps.push(header.hash());
+        }
+        let transaction = rtx
+            .transaction
+            .as_advanced_builder()
+            .set_header_deps(header_deps)
+            .build();
+        let rtx = ResolvedTransaction { transaction, ..rtx };
+        // the lock signs the original header deps, verify DCKB alone
+        verify_group(&rtx, &data_loader, ScriptGroupType::Type, dckb_script())
+    };
+    // header deps after the used ones are never loaded
+    verify(0, 300, false).expect("pass verification");
+    verify(0, 0, true).expect("pass verification");
+    verify(200, 0, true).expect("pass verification");
+    // the used header deps are after MAX_HEADER_DEPS header deps
+    assert_error_code(verify(300, 0, false), ERROR_TOO_MANY_HEADER_DEPS);
+}
+
+// `count` header deps of blocks no cell is deposited in
+fn noise_header_deps(data_loader: &mut DummyDataLoader, count: usize) -> Vec<Byte32> {
+    (0..count)
+        .map(|i| {
+            let (header, epoch) = gen_header(5000 + i as u64, 10000100 + i as u64, 40, 1000, 1000);
+            data_loader.headers.insert(header.hash(), header.clone());
+            data_loader.epoches.insert(header.hash(), epoch);
+            header.hash()
+        })
+        .collect()
+}
+
+// deposit several NervosDAO cells of one dao lock and one of a dao lock that
+// refers to another type hash, mint `minted_coin`
+fn shared_lock_deposit_verify(minted_coin: u64) -> bool {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let deposits = 4;
+    let deposit_capacity = 200_00000000;
+    let input_capacity = deposit_capacity * (deposits + 1) + DCKB_CAPACITY.as_u64();
+    let (cell, previous_out_point) = gen_normal_cell(
+        &mut data_loader,
+        Capacity::shannons(input_capacity),
+        lock_args.clone(),
+    );
+    let input_cell_meta = CellMetaBuilder::from_cell_output(cell.clone(), Bytes::new())
+        .out_point(previous_out_point.clone())
+        .build();
+
+    let dao_lock = gen_dao_lock_lock_script(cell.lock().calc_script_hash().unpack());
+    let other_dao_lock = dao_lock
+        .clone()
+        .as_builder()
+        .args(Bytes::from(vec![0u8; 64]).pack())
+        .build();
+    let mut builder = TransactionBuilder::default().input(CellInput::new(previous_out_point, 0));
+    for lock in vec![dao_lock; deposits as usize]
+        .into_iter()
+        .chain(Some(other_dao_lock))
+    {
+        let (output_cell, _) =
+            gen_dao_cell(&mut data_loader, Capacity::shannons(deposit_capacity), lock);
+        builder = builder
+            .output(output_cell)
+            .output_data(Bytes::from(vec![0u8; 8]).pack());
+    }
+    let (dckb_output_cell, _, dckb_output_data) =
+        gen_dckb_cell(&mut data_loader, minted_coin, 0, lock_args);
+    let builder = builder
+        .output(dckb_output_cell)
+        .output_data(dckb_output_data.pack())
+        .witness(WitnessArgs::default().as_bytes().pack());
+    let (tx, resolved_cell_deps) = complete_tx(&mut data_loader, builder);
+    let tx = sign_tx(tx, &privkey);
+    let rtx = ResolvedTransaction {
+        transaction: tx,
+        resolved_inputs: vec![input_cell_meta],
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    };
+    verify_tx(&rtx, &data_loader).is_ok()
+}
+
+#[test]
+fn test_dckb_deposit_shared_locks() {
+    let deposited = (200_00000000 - DAO_OCCUPIED_CAPACITY) * 4;
+    assert!(shared_lock_deposit_verify(deposited));
+    // the deposit of the other dao lock is not counted
+    assert!(!shared_lock_deposit_verify(
+        deposited + 200_00000000 - DAO_OCCUPIED_CAPACITY
+    ));
+}
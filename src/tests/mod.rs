@@ -1,21 +1,31 @@
+mod bench;
 mod dao_lock;
 mod dckb;
+#[cfg(feature = "native-verifier")]
+mod native;
+mod replay;
+mod selector;
 
 use ckb_crypto::secp::Privkey;
-use ckb_script::DataLoader;
+use ckb_error::Error;
+use ckb_script::{DataLoader, ScriptGroupType, TransactionScriptsVerifier};
 use ckb_types::{
     bytes::Bytes,
     core::{
-        cell::{CellMeta, CellMetaBuilder},
-        BlockExt, BlockNumber, Capacity, DepType, EpochExt, EpochNumber, HeaderBuilder, HeaderView,
-        ScriptHashType, TransactionBuilder, TransactionView,
+        cell::{CellMeta, CellMetaBuilder, ResolvedTransaction},
+        BlockExt, BlockNumber, Capacity, Cycle, DepType, EpochExt, EpochNumber, HeaderBuilder,
+        HeaderView, ScriptHashType, TransactionBuilder, TransactionView,
     },
     packed::{self, Byte32, CellDep, CellOutput, OutPoint, Script, WitnessArgs},
     prelude::*,
     H256,
 };
 use lazy_static::lazy_static;
-use std::collections::HashMap;
+use std::{
+    cell::RefCell,
+    collections::{HashMap, HashSet},
+    rc::Rc,
+};
 
 use ckb_crypto::secp::Generator;
 use ckb_dao_utils::pack_dao_data;
@@ -27,8 +37,24 @@ pub const MAX_CYCLES: u64 = std::u64::MAX;
 pub const SIGNATURE_SIZE: usize = 65;
 pub const DAO_OCCUPIED_CAPACITY: u64 = 146_00000000u64;
 pub const SECP_OCCUPIED_CAPACITY: u64 = 61_00000000u64;
-
-// errors
+// set to print the phase breakdown, the scripts must be built with PHASES=1
+pub const PHASES_ENV: &str = "DCKB_PHASES";
+// debug message of a phase marker, see c/phase.h
+const PHASE_MARKER: &str = "phase ";
+
+// errors, see c/common.h and c/dao_utils.h
+pub const ERROR_ENCODING: i8 = -2;
+pub const ERROR_INVALID_WITHDRAW_BLOCK: i8 = -14;
+pub const ERROR_DCKB_INCORRECT_OUTPUT: i8 = -30;
+pub const ERROR_DCKB_HEADER_HINT: i8 = -35;
+pub const ERROR_DCKB_DESTROY_AMOUNT: i8 = -36;
+pub const ERROR_DL_NO_CUSTODIAN_CELL_INDEX: i8 = -42;
+pub const ERROR_DL_INCORRECT_DESTROY_AMOUNT: i8 = -43;
+pub const ERROR_DL_INCOMPLETE_BATCH: i8 = -48;
+pub const ERROR_LOAD_HEADER: i8 = -60;
+pub const ERROR_LOAD_DCKB_DATA: i8 = -68;
+pub const ERROR_TOO_MANY_HEADER_DEPS: i8 = -74;
+pub const ERROR_ARENA_EXHAUSTED: i8 = -76;
 
 lazy_static! {
     static ref DCKB: Bytes = Bytes::from(&include_bytes!("../../specs/cells/dckb")[..]);
@@ -179,6 +205,14 @@ fn dckb_data(ckb: u128, block_number: u64) -> Bytes {
     data.to_vec().into()
 }
 
+// compact DCKB data, version 1 | amount | block number
+fn dckb_compact_data(ckb: u64, block_number: u64) -> Bytes {
+    let mut data = vec![1u8];
+    data.extend_from_slice(&ckb.to_le_bytes()[..]);
+    data.extend_from_slice(&block_number.to_le_bytes()[..]);
+    data.into()
+}
+
 fn dckb_cell_output() -> CellOutput {
     CellOutput::new_builder()
         .capacity(DCKB_CAPACITY.pack())
@@ -549,3 +583,237 @@ fn calculate_dao_capacity(
     let withdraw_capacity = occupied_capacity + (withdraw_counted_capacity as u64);
     withdraw_capacity
 }
+
+// asserts a verification fails with the script error code
+fn assert_error_code<T: std::fmt::Debug>(result: Result<T, Error>, code: i8) {
+    let err = result.expect_err("fail verification").to_string();
+    assert!(
+        err.contains(&format!("ValidationFailure({})", code)),
+        "expect error code {}, got {}",
+        code,
+        err
+    );
+}
+
+// verifies the script group of script alone
+fn verify_group(
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+    group_type: ScriptGroupType,
+    script: Script,
+) -> Result<Cycle, Error> {
+    TransactionScriptsVerifier::new(rtx, data_loader).verify_single(
+        group_type,
+        &script.calc_script_hash(),
+        MAX_CYCLES,
+    )
+}
+
+// resizes the lock args of a resolved input, keeps the leading bytes and pads
+// with zeros
+fn resize_input_lock_args(rtx: &mut ResolvedTransaction, index: usize, args_len: usize) {
+    let cell_output = rtx.resolved_inputs[index].cell_output.clone();
+    let lock = cell_output.lock();
+    let mut args = lock.args().raw_data().to_vec();
+    args.resize(args_len, 0);
+    let lock = lock.as_builder().args(Bytes::from(args).pack()).build();
+    rtx.resolved_inputs[index].cell_output = cell_output.as_builder().lock(lock).build();
+}
+
+// phase marker of a verification, (script group, phase)
+type PhaseMarker = (Byte32, String);
+
+// verifies the transaction, or the script group if given, under the cycles
+// limit. Phase markers of the debug output are collected in printed order,
+// other debug messages are printed
+fn verify_with_markers(
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+    group: Option<(&ScriptGroupType, &Byte32)>,
+    max_cycles: Cycle,
+) -> (Result<Cycle, Error>, Vec<PhaseMarker>) {
+    let markers = Rc::new(RefCell::new(Vec::new()));
+    let printed = Rc::clone(&markers);
+    let mut verifier = TransactionScriptsVerifier::new(rtx, data_loader);
+    verifier.set_debug_printer(move |hash, msg| {
+        if msg.starts_with(PHASE_MARKER) {
+            let phase = msg[PHASE_MARKER.len()..].to_string();
+            printed.borrow_mut().push((hash.clone(), phase));
+        } else {
+            println!("msg {}", msg);
+        }
+    });
+    let result = match group {
+        Some((group_type, hash)) => verifier.verify_single(group_type.clone(), hash, max_cycles),
+        None => verifier.verify(max_cycles),
+    };
+    let markers = markers.borrow().clone();
+    (result, markers)
+}
+
+// verifies the transaction as the tests do, in a single run. With DCKB_PHASES
+// set, the phase table of the transaction is printed from the markers of the
+// run, under the name of the test
+fn verify_tx(rtx: &ResolvedTransaction, data_loader: &DummyDataLoader) -> Result<Cycle, Error> {
+    let (result, markers) = verify_with_markers(rtx, data_loader, None, MAX_CYCLES);
+    if std::env::var(PHASES_ENV).is_ok() && !markers.is_empty() {
+        let thread = std::thread::current();
+        print_phase_table(thread.name().unwrap_or("tx"), rtx, data_loader, &markers);
+    }
+    result
+}
+
+// names of the DCKB scripts in the transaction by script hash
+fn script_names(rtx: &ResolvedTransaction) -> HashMap<Byte32, &'static str> {
+    let binaries = [
+        (CellOutput::calc_data_hash(&DCKB), "dckb"),
+        (CellOutput::calc_data_hash(&DAO_LOCK), "dao_lock"),
+        (
+            CellOutput::calc_data_hash(&CUSTODIAN_LOCK),
+            "custodian_lock",
+        ),
+    ];
+    let outputs = rtx.transaction.outputs().into_iter();
+    let scripts = rtx
+        .resolved_inputs
+        .iter()
+        .map(|cell| cell.cell_output.clone())
+        .chain(outputs)
+        .flat_map(|output| vec![Some(output.lock()), output.type_().to_opt()])
+        .flatten();
+    let mut names = HashMap::new();
+    for script in scripts {
+        if let Some((_, name)) = binaries
+            .iter()
+            .find(|(hash, _)| *hash == script.code_hash())
+        {
+            names.insert(script.calc_script_hash(), *name);
+        }
+    }
+    names
+}
+
+// script groups of the transaction, locks then types in transaction order
+fn script_groups(rtx: &ResolvedTransaction) -> Vec<(ScriptGroupType, Byte32)> {
+    let lock_hashes = rtx.resolved_inputs.iter().map(|cell| {
+        (
+            ScriptGroupType::Lock,
+            cell.cell_output.lock().calc_script_hash(),
+        )
+    });
+    let type_hashes = rtx
+        .resolved_inputs
+        .iter()
+        .map(|cell| cell.cell_output.clone())
+        .chain(rtx.transaction.outputs().into_iter())
+        .filter_map(|output| output.type_().to_opt())
+        .map(|script| (ScriptGroupType::Type, script.calc_script_hash()));
+    let mut seen = HashSet::new();
+    lock_hashes
+        .chain(type_hashes)
+        .filter(|(_, hash)| seen.insert(hash.clone()))
+        .collect()
+}
+
+/// Cycles of each DCKB script group as (script, cycles), locks then types in
+/// transaction order, groups failing the verification are skipped.
+pub fn script_group_cycles(
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+) -> Vec<(&'static str, Cycle)> {
+    let verifier = TransactionScriptsVerifier::new(rtx, data_loader);
+    let names = script_names(rtx);
+    let mut script_cycles = Vec::new();
+    for (group_type, hash) in script_groups(rtx) {
+        let name = match names.get(&hash) {
+            Some(name) => *name,
+            None => continue,
+        };
+        if let Ok(cycles) = verifier.verify_single(group_type, &hash, MAX_CYCLES) {
+            script_cycles.push((name, cycles));
+        }
+    }
+    script_cycles
+}
+
+/// Cycles of each script phase as (script, phase, cycles), by script group in
+/// the order of the markers, the cycles of a phase count from the previous
+/// marker of the same script group. markers are the phase markers of a
+/// verification of the transaction, empty unless the scripts are built with
+/// PHASES=1.
+///
+/// The VM has no syscall to read the cycles, a marker is printed iff the
+/// cycles limit covers the cycles up to it, so the cycles of a marker are the
+/// lowest limit that prints it. Each is searched by verifying its script group
+/// alone, between the previous marker and the cycles of the group.
+pub fn phase_cycles(
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+    markers: &[PhaseMarker],
+) -> Vec<(String, String, Cycle)> {
+    let names = script_names(rtx);
+    let mut phases = Vec::new();
+    for (group_type, hash) in script_groups(rtx) {
+        let group_markers: Vec<&String> = markers
+            .iter()
+            .filter(|(marker_hash, _)| *marker_hash == hash)
+            .map(|(_, phase)| phase)
+            .collect();
+        if group_markers.is_empty() {
+            continue;
+        }
+        let group = Some((&group_type, &hash));
+        let printed = |limit| verify_with_markers(rtx, data_loader, group, limit).1.len();
+        // a failing group gives no cycles, search up from the previous marker
+        let group_cycles = verify_with_markers(rtx, data_loader, group, MAX_CYCLES)
+            .0
+            .ok();
+        let name = names.get(&hash).cloned().unwrap_or("other");
+        // printed(lo) <= k < printed(hi), markers are reached at increasing cycles
+        let mut lo = 0;
+        let mut last = None;
+        for (k, phase) in group_markers.into_iter().enumerate() {
+            let mut hi = match group_cycles {
+                Some(cycles) => cycles + 1,
+                None => {
+                    let mut step = 1 << 16;
+                    let mut hi = lo + step;
+                    while printed(hi) <= k {
+                        lo = hi;
+                        step *= 2;
+                        hi = lo + step;
+                    }
+                    hi
+                }
+            };
+            while hi - lo > 1 {
+                let mid = lo + (hi - lo) / 2;
+                if printed(mid) > k {
+                    hi = mid;
+                } else {
+                    lo = mid;
+                }
+            }
+            lo = hi;
+            if let Some(last) = last {
+                phases.push((name.to_string(), phase.clone(), hi - last));
+            }
+            last = Some(hi);
+        }
+    }
+    phases
+}
+
+/// Prints the phase breakdown table of a transaction, see phase_cycles.
+pub fn print_phase_table(
+    name: &str,
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+    markers: &[PhaseMarker],
+) {
+    println!("{}", name);
+    println!("  {:<16} {:<28} {:>12}", "script", "phase", "cycles");
+    for (script, phase, cycles) in phase_cycles(rtx, data_loader, markers) {
+        println!("  {:<16} {:<28} {:>12}", script, phase, cycles);
+    }
+}
@@ -0,0 +1,357 @@
+use super::dao_lock::{dao_lock_script, phase2_unlock_tx};
+use super::dckb::align_transfer_tx;
+use super::*;
+use crate::native::{self, helpers, TxSyscalls};
+use std::fmt::Debug;
+
+// see c/common.h
+const ERROR_OVERFLOW: i8 = -4;
+
+// asserts the native script returns the exit code of the VM for the script group
+fn assert_parity<C: Debug>(
+    rtx: &ResolvedTransaction,
+    data_loader: &DummyDataLoader,
+    group_type: ScriptGroupType,
+    script: Script,
+    native_script: native::Script,
+    case: C,
+) {
+    let syscalls = match group_type {
+        ScriptGroupType::Lock => TxSyscalls::new_lock(rtx, data_loader, script.clone()),
+        ScriptGroupType::Type => TxSyscalls::new_type(rtx, data_loader, script.clone()),
+    };
+    let ret = native::verify(native_script, &syscalls);
+    match verify_group(rtx, data_loader, group_type, script) {
+        Ok(_) => assert_eq!(ret, 0, "native returns {} {:?}", ret, case),
+        Err(err) => assert!(
+            err.to_string()
+                .contains(&format!("ValidationFailure({})", ret)),
+            "native returns {}, VM {} {:?}",
+            ret,
+            err,
+            case
+        ),
+    }
+}
+
+#[test]
+fn test_native_dckb_transfer() {
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    let cases: Vec<(u64, &[u8])> = vec![
+        (aligned_coin, &[]),
+        (aligned_coin + 1, &[]),
+        (aligned_coin, &[1, 0]),
+        (aligned_coin, &[0, 0]),
+        (aligned_coin, &[1]),
+    ];
+    for (output_coin, header_hints) in cases {
+        let (rtx, data_loader) = align_transfer_tx(ar1, ar2, coin, output_coin, header_hints);
+        assert_parity(
+            &rtx,
+            &data_loader,
+            ScriptGroupType::Type,
+            dckb_script(),
+            native::Script::Dckb,
+            (output_coin, header_hints),
+        );
+    }
+}
+
+#[test]
+fn test_native_dao_lock_phase2_unlock() {
+    // (dao lock witness lock, destroy amount error, dao lock args length)
+    let custodian_cell_index: u8 = 2;
+    let cases: Vec<(Vec<u8>, Option<u64>, usize)> = vec![
+        (vec![custodian_cell_index], None, 64),
+        (vec![custodian_cell_index], Some(1), 64),
+        (vec![custodian_cell_index, 1], None, 64),
+        (vec![custodian_cell_index, 0], None, 64),
+        (vec![custodian_cell_index, 1, 1], None, 64),
+        (vec![], None, 64),
+        (vec![custodian_cell_index], None, 63),
+    ];
+    for (witness_lock, destroy_amount_error, args_len) in cases {
+        let case = (witness_lock.clone(), destroy_amount_error, args_len);
+        let (mut rtx, data_loader) = phase2_unlock_tx(witness_lock, destroy_amount_error, 0);
+        resize_input_lock_args(&mut rtx, 0, args_len);
+        let dao_lock = dao_lock_script(&rtx);
+        assert_parity(
+            &rtx,
+            &data_loader,
+            ScriptGroupType::Lock,
+            dao_lock,
+            native::Script::DaoLock,
+            case,
+        );
+    }
+}
+
+#[test]
+fn test_native_custodian_lock_phase2_unlock() {
+    // the custodian cell is input 2, unlocked by input 1
+    let custodian_cell_index = 2;
+    for &args_len in &[32, 31, 33] {
+        let (mut rtx, data_loader) = phase2_unlock_tx(vec![custodian_cell_index as u8], None, 0);
+        resize_input_lock_args(&mut rtx, custodian_cell_index, args_len);
+        let custodian_lock = rtx.resolved_inputs[custodian_cell_index].cell_output.lock();
+        assert_parity(
+            &rtx,
+            &data_loader,
+            ScriptGroupType::Lock,
+            custodian_lock,
+            native::Script::CustodianLock,
+            args_len,
+        );
+    }
+}
+
+#[test]
+fn test_native_concurrent_runs() {
+    // passing and failing transfers on several threads at once, every run
+    // returns the exit code of the VM
+    let (ar1, ar2, coin) = (10000000, 10001000, 100000_00000000);
+    let aligned_coin = (coin as u128 * ar2 as u128 / ar1 as u128) as u64;
+    let threads: Vec<_> = (0..8)
+        .map(|i| {
+            std::thread::spawn(move || {
+                let output_coin = aligned_coin + i % 2;
+                let (rtx, data_loader) = align_transfer_tx(ar1, ar2, coin, output_coin, &[]);
+                for _ in 0..20 {
+                    assert_parity(
+                        &rtx,
+                        &data_loader,
+                        ScriptGroupType::Type,
+                        dckb_script(),
+                        native::Script::Dckb,
+                        output_coin,
+                    );
+                }
+            })
+        })
+        .collect();
+    for thread in threads {
+        thread.join().expect("native run");
+    }
+}
+
+// operands of udiv128_mul_div, random and near the edges
+fn gen_operand<R: Rng>(rng: &mut R) -> u64 {
+    match rng.gen_range(0, 6) {
+        0 => rng.gen(),
+        1 => rng.gen::<u64>() >> rng.gen_range(0u32, 64),
+        2 => (1u64 << rng.gen_range(0u32, 64))
+            .wrapping_add(rng.gen_range(0, 3))
+            .wrapping_sub(1),
+        3 => std::u64::MAX - rng.gen_range(0, 4),
+        4 => rng.gen_range(0, 4),
+        _ => rng.gen::<u32>().into(),
+    }
+}
+
+#[test]
+fn test_native_udiv128_mul_div() {
+    let mut rng = thread_rng();
+    for _ in 0..1_000_000 {
+        let (a, b, d) = (
+            gen_operand(&mut rng),
+            gen_operand(&mut rng),
+            gen_operand(&mut rng),
+        );
+        let expected = if d == 0 {
+            None
+        } else {
+            let q = u128::from(a) * u128::from(b) / u128::from(d);
+            if q > u128::from(std::u64::MAX) {
+                None
+            } else {
+                Some(q as u64)
+            }
+        };
+        let ret = helpers::udiv128_mul_div(a, b, d);
+        match expected {
+            Some(q) => assert_eq!(ret, Ok(q), "{} * {} / {}", a, b, d),
+            None => assert_eq!(ret, Err(ERROR_OVERFLOW), "{} * {} / {}", a, b, d),
+        }
+    }
+}
+
+// serves one witness of input 0
+struct WitnessSyscalls(Vec<u8>);
+
+impl native::Syscalls for WitnessSyscalls {
+    fn load(&self, syscall: u64, index: u64, _source: u64, _field: u64) -> Result<Vec<u8>, u8> {
+        match (syscall, index) {
+            (native::SYS_LOAD_WITNESS, 0) => Ok(self.0.clone()),
+            _ => Err(native::INDEX_OUT_OF_BOUND),
+        }
+    }
+}
+
+fn pack_number(buf: &mut Vec<u8>, n: usize) {
+    buf.extend_from_slice(&(n as u32).to_le_bytes());
+}
+
+// a WitnessArgs of none or random fields short and beyond the prefix
+// loaded by c/witness.h, then maybe corrupted in the header, truncated,
+// extended or changed in a random byte
+fn gen_witness<R: Rng>(rng: &mut R) -> Vec<u8> {
+    let mut fields = Vec::new();
+    let mut offsets = Vec::new();
+    let header_size = 4 * (helpers::WITNESS_ARGS_FIELD_COUNT as usize + 1);
+    for _ in 0..helpers::WITNESS_ARGS_FIELD_COUNT {
+        offsets.push(header_size + fields.len());
+        if rng.gen_range(0, 4) > 0 {
+            let len = match rng.gen_range(0, 3) {
+                0 => rng.gen_range(0, 8),
+                1 => rng.gen_range(0, 200),
+                _ => rng.gen_range(0, 2000),
+            };
+            pack_number(&mut fields, len);
+            fields.extend((0..len).map(|_| rng.gen::<u8>()));
+        }
+    }
+    let mut witness = Vec::new();
+    pack_number(&mut witness, header_size + fields.len());
+    for offset in offsets {
+        pack_number(&mut witness, offset);
+    }
+    witness.extend(fields);
+    match rng.gen_range(0, 4) {
+        0 => {}
+        1 => {
+            let header = witness.len().min(header_size + 8);
+            for _ in 0..rng.gen_range(1, 4) {
+                let i = rng.gen_range(0, header);
+                witness[i] = if rng.gen_range(0, 3) == 0 {
+                    rng.gen()
+                } else {
+                    witness[i].wrapping_add(rng.gen_range(0, 5)).wrapping_sub(2)
+                };
+            }
+        }
+        2 => {
+            if rng.gen() {
+                let len = rng.gen_range(0, witness.len());
+                witness.truncate(len);
+            } else {
+                let extra = rng.gen_range(0, 8);
+                witness.extend((0..extra).map(|_| rng.gen::<u8>()));
+            }
+        }
+        _ => {
+            let i = rng.gen_range(0, witness.len());
+            witness[i] = rng.gen();
+        }
+    }
+    witness
+}
+
+#[test]
+fn test_native_witness_args_fields() {
+    // c/witness.h reads the fields the molecule reader reads from the whole
+    // witness, and rejects what it rejects
+    let mut rng = thread_rng();
+    let mut valid = 0;
+    for _ in 0..50_000 {
+        let witness = gen_witness(&mut rng);
+        let syscalls = WitnessSyscalls(witness.clone());
+        for field in 0..helpers::WITNESS_ARGS_FIELD_COUNT {
+            let expected = helpers::mol_witness_args_field(&witness, field);
+            if field == 0 && expected.is_ok() {
+                valid += 1;
+            }
+            assert_eq!(
+                helpers::witness_args_field(&syscalls, field),
+                expected,
+                "field {} of {:?}",
+                field,
+                witness
+            );
+        }
+    }
+    // both valid and malformed witnesses are covered
+    assert!(
+        valid > 10_000 && valid < 40_000,
+        "{} valid witnesses",
+        valid
+    );
+}
+
+// a Script of args_len or random bytes args, then maybe corrupted in the
+// header or the args length, truncated, extended or changed in a random byte
+fn gen_script<R: Rng>(rng: &mut R, args_len: usize) -> Vec<u8> {
+    let args_len = if rng.gen() {
+        args_len
+    } else {
+        rng.gen_range(0, 70)
+    };
+    let code_hash_offset = 16;
+    let hash_type_offset = code_hash_offset + 32;
+    let args_offset = hash_type_offset + 1;
+    let mut script = Vec::new();
+    pack_number(&mut script, args_offset + 4 + args_len);
+    pack_number(&mut script, code_hash_offset);
+    pack_number(&mut script, hash_type_offset);
+    pack_number(&mut script, args_offset);
+    script.extend((0..33).map(|_| rng.gen::<u8>()));
+    pack_number(&mut script, args_len);
+    script.extend((0..args_len).map(|_| rng.gen::<u8>()));
+    match rng.gen_range(0, 4) {
+        0 => {}
+        1 => {
+            let i = if rng.gen() {
+                rng.gen_range(0, code_hash_offset)
+            } else {
+                args_offset + rng.gen_range(0, 4)
+            };
+            script[i] = if rng.gen() {
+                rng.gen()
+            } else {
+                script[i].wrapping_add(rng.gen_range(0, 3)).wrapping_sub(1)
+            };
+        }
+        2 => {
+            if rng.gen() {
+                let len = rng.gen_range(0, script.len());
+                script.truncate(len);
+            } else {
+                let extra = rng.gen_range(0, 4);
+                script.extend((0..extra).map(|_| rng.gen::<u8>()));
+            }
+        }
+        _ => {
+            let i = rng.gen_range(0, script.len());
+            script[i] = rng.gen();
+        }
+    }
+    script
+}
+
+#[test]
+fn test_native_verify_script_layout() {
+    // verify_script_layout accepts a Script of the expected size if and only
+    // if the molecule verifier does
+    let mut rng = thread_rng();
+    let mut valid = 0;
+    for _ in 0..50_000 {
+        let args_len = [0, 32, 64][rng.gen_range(0, 3)];
+        let script = gen_script(&mut rng, args_len);
+        // SCRIPT_SIZE_WITH_ARGS(args_len) in c/common.h
+        let size = 53 + args_len;
+        let expected = if script.len() == size && helpers::mol_verify_script(&script) == 0 {
+            valid += 1;
+            0
+        } else {
+            ERROR_ENCODING
+        };
+        assert_eq!(
+            helpers::verify_script_layout(&script, args_len),
+            expected,
+            "{} bytes args {:?}",
+            args_len,
+            script
+        );
+    }
+    assert!(valid > 10_000 && valid < 40_000, "{} valid scripts", valid);
+}
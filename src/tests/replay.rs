@@ -0,0 +1,312 @@
+//! Corpus replay benchmark
+//!
+//! Verifies a corpus of recorded transactions in parallel and reports the
+//! throughput, the cycles of each DCKB script and the transactions whose
+//! outcome differs from the recorded one.
+//!
+//! The corpus is a JSON lines file, each line is a ckb-debugger mock
+//! transaction (see `mock_tx` in bench.rs) with the recorded `result`,
+//! `{"cycles": <cycles>}` or `{"error": "<error>"}`. `make corpus` records the
+//! bench scenarios, `make replay CORPUS=<path>` replays a corpus.
+
+use super::*;
+use ckb_jsonrpc_types as json;
+use ckb_types::core::TransactionInfo;
+use memmap::Mmap;
+use serde::{Deserialize, Serialize};
+use std::{
+    env,
+    fs::File,
+    sync::Arc,
+    thread,
+    time::{Duration, Instant},
+};
+
+// path of the corpus to replay
+const CORPUS_ENV: &str = "DCKB_CORPUS";
+// replay threads, all cores by default
+const THREADS_ENV: &str = "DCKB_REPLAY_THREADS";
+
+#[derive(Clone, Debug, PartialEq, Eq, Serialize, Deserialize)]
+#[serde(rename_all = "snake_case")]
+pub enum Outcome {
+    Cycles(Cycle),
+    Error(String),
+}
+
+impl Outcome {
+    pub fn verify(rtx: &ResolvedTransaction, data_loader: &DummyDataLoader) -> Self {
+        match TransactionScriptsVerifier::new(rtx, data_loader).verify(MAX_CYCLES) {
+            Ok(cycles) => Outcome::Cycles(cycles),
+            Err(err) => Outcome::Error(err.to_string()),
+        }
+    }
+}
+
+#[derive(Deserialize)]
+struct MockCell {
+    output: json::CellOutput,
+    data: json::JsonBytes,
+    #[serde(default)]
+    header: Option<H256>,
+}
+
+#[derive(Deserialize)]
+struct MockInput {
+    input: json::CellInput,
+    #[serde(flatten)]
+    cell: MockCell,
+}
+
+#[derive(Deserialize)]
+struct MockCellDep {
+    cell_dep: json::CellDep,
+    #[serde(flatten)]
+    cell: MockCell,
+}
+
+#[derive(Deserialize)]
+struct MockInfo {
+    inputs: Vec<MockInput>,
+    cell_deps: Vec<MockCellDep>,
+    header_deps: Vec<json::HeaderView>,
+}
+
+#[derive(Deserialize)]
+struct Record {
+    mock_info: MockInfo,
+    tx: json::Transaction,
+    result: Outcome,
+}
+
+// resolve a record, headers are put into data_loader
+fn resolve_record(record: Record, data_loader: &mut DummyDataLoader) -> ResolvedTransaction {
+    data_loader.headers.clear();
+    for header in record.mock_info.header_deps {
+        let header = packed::Header::from(header.inner).into_view();
+        data_loader.headers.insert(header.hash(), header);
+    }
+    let cell_meta = |out_point: OutPoint, cell: MockCell| {
+        let builder = CellMetaBuilder::from_cell_output(cell.output.into(), cell.data.into_bytes())
+            .out_point(out_point);
+        let header = cell
+            .header
+            .and_then(|hash| data_loader.headers.get(&hash.pack()));
+        match header {
+            Some(header) => builder
+                .transaction_info(TransactionInfo {
+                    block_hash: header.hash(),
+                    block_number: header.number(),
+                    block_epoch: header.epoch(),
+                    index: 0,
+                })
+                .build(),
+            None => builder.build(),
+        }
+    };
+    let resolved_inputs = record
+        .mock_info
+        .inputs
+        .into_iter()
+        .map(|input| {
+            let input: packed::CellInput = input.input.into();
+            cell_meta(input.previous_output(), input.cell)
+        })
+        .collect();
+    // cell deps by out point, and whether a cell dep is a dep group
+    let cell_deps: HashMap<OutPoint, (bool, CellMeta)> = record
+        .mock_info
+        .cell_deps
+        .into_iter()
+        .map(|mock| {
+            let is_dep_group = match mock.cell_dep.dep_type {
+                json::DepType::DepGroup => true,
+                json::DepType::Code => false,
+            };
+            let out_point = packed::CellDep::from(mock.cell_dep).out_point();
+            let meta = cell_meta(out_point.clone(), mock.cell);
+            (out_point, (is_dep_group, meta))
+        })
+        .collect();
+    let transaction = packed::Transaction::from(record.tx).into_view();
+    let mut resolved_cell_deps = Vec::new();
+    let mut resolved_dep_groups = Vec::new();
+    for cell_dep in transaction.cell_deps().into_iter() {
+        let (is_dep_group, meta) = cell_deps
+            .get(&cell_dep.out_point())
+            .cloned()
+            .expect("mock cell dep");
+        if is_dep_group {
+            let data = meta.mem_cell_data.clone().expect("dep group data").0;
+            let out_points = packed::OutPointVec::from_slice(&data).expect("dep group");
+            for out_point in out_points.into_iter() {
+                let (_, member) = cell_deps
+                    .get(&out_point)
+                    .cloned()
+                    .expect("mock dep group member");
+                resolved_cell_deps.push(member);
+            }
+            resolved_dep_groups.push(meta);
+        } else {
+            resolved_cell_deps.push(meta);
+        }
+    }
+    ResolvedTransaction {
+        transaction,
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups,
+    }
+}
+
+// replayed result of a transaction
+struct Replay {
+    line: usize,
+    recorded: Outcome,
+    replayed: Outcome,
+    verify_time: Duration,
+    // cycles of each DCKB script group, by script name
+    script_cycles: Vec<(&'static str, Cycle)>,
+}
+
+fn replay_record(line: usize, bytes: &[u8], data_loader: &mut DummyDataLoader) -> Replay {
+    let record: Record = serde_json::from_slice(bytes)
+        .unwrap_or_else(|err| panic!("corpus line {}: {}", line + 1, err));
+    let recorded = record.result.clone();
+    let rtx = resolve_record(record, data_loader);
+    let start = Instant::now();
+    let replayed = Outcome::verify(&rtx, data_loader);
+    let verify_time = start.elapsed();
+    let script_cycles = script_group_cycles(&rtx, data_loader);
+    Replay {
+        line,
+        recorded,
+        replayed,
+        verify_time,
+        script_cycles,
+    }
+}
+
+// line ranges of a JSON lines file, blank lines are skipped
+fn corpus_lines(corpus: &[u8]) -> Vec<(usize, usize)> {
+    let mut lines = Vec::new();
+    let mut start = 0;
+    for (i, &byte) in corpus.iter().enumerate().chain(Some((corpus.len(), b'\n'))) {
+        if byte == b'\n' {
+            if corpus[start..i].iter().any(|b| !b.is_ascii_whitespace()) {
+                lines.push((start, i));
+            }
+            start = i + 1;
+        }
+    }
+    lines
+}
+
+fn percentile(sorted: &[Cycle], percent: usize) -> Cycle {
+    sorted[(sorted.len() * percent / 100).min(sorted.len() - 1)]
+}
+
+#[test]
+fn replay_corpus() {
+    let path = match env::var(CORPUS_ENV) {
+        Ok(path) => path,
+        Err(_) => return,
+    };
+    let file = File::open(&path).expect("open corpus");
+    let corpus = Arc::new(unsafe { Mmap::map(&file) }.expect("map corpus"));
+    let lines = Arc::new(corpus_lines(&corpus));
+    let threads = env::var(THREADS_ENV)
+        .ok()
+        .map(|threads| threads.parse().expect("threads"))
+        .unwrap_or_else(num_cpus::get)
+        .max(1);
+
+    let handles: Vec<_> = (0..threads)
+        .map(|t| {
+            let corpus = Arc::clone(&corpus);
+            let lines = Arc::clone(&lines);
+            thread::spawn(move || {
+                let mut data_loader = DummyDataLoader::new();
+                (t..lines.len())
+                    .step_by(threads)
+                    .map(|i| {
+                        let (begin, end) = lines[i];
+                        replay_record(i, &corpus[begin..end], &mut data_loader)
+                    })
+                    .collect::<Vec<_>>()
+            })
+        })
+        .collect();
+    let mut replays: Vec<Replay> = handles
+        .into_iter()
+        .flat_map(|handle| handle.join().expect("replay thread"))
+        .collect();
+    replays.sort_by_key(|replay| replay.line);
+
+    // throughput of the verifier alone, parsing and the per script runs are
+    // not counted
+    let seconds: f64 = replays
+        .iter()
+        .map(|replay| replay.verify_time.as_secs_f64())
+        .sum();
+    println!(
+        "replayed {} transactions on {} threads, {:.1} tx/s",
+        replays.len(),
+        threads,
+        replays.len() as f64 * threads as f64 / seconds
+    );
+    let mut cycles_by_script: HashMap<&str, Vec<Cycle>> = HashMap::new();
+    for replay in &replays {
+        for &(name, cycles) in &replay.script_cycles {
+            cycles_by_script.entry(name).or_default().push(cycles);
+        }
+    }
+    println!(
+        "{:<16} {:>8} {:>14} {:>14}",
+        "script", "groups", "p50", "p99"
+    );
+    for name in &["dckb", "dao_lock", "custodian_lock"] {
+        if let Some(cycles) = cycles_by_script.get_mut(name) {
+            cycles.sort();
+            println!(
+                "{:<16} {:>8} {:>14} {:>14}",
+                name,
+                cycles.len(),
+                percentile(cycles, 50),
+                percentile(cycles, 99)
+            );
+        }
+    }
+
+    // a change of cycles is expected from optimizations, a change of the
+    // outcome is not
+    let (mut recorded_cycles, mut replayed_cycles) = (0u64, 0u64);
+    let mut differences = Vec::new();
+    for replay in &replays {
+        match (&replay.recorded, &replay.replayed) {
+            (Outcome::Cycles(recorded), Outcome::Cycles(replayed)) => {
+                recorded_cycles += recorded;
+                replayed_cycles += replayed;
+            }
+            (recorded, replayed) if recorded != replayed => {
+                differences.push(format!(
+                    "line {}: recorded {:?}, replayed {:?}",
+                    replay.line + 1,
+                    recorded,
+                    replayed
+                ));
+            }
+            _ => {}
+        }
+    }
+    println!(
+        "cycles of passing transactions: recorded {}, replayed {}",
+        recorded_cycles, replayed_cycles
+    );
+    assert!(
+        differences.is_empty(),
+        "{} outcome differences:\n{}",
+        differences.len(),
+        differences.join("\n")
+    );
+}
@@ -0,0 +1,161 @@
+use super::*;
+use crate::selector::{self, DaoHeader, DckbCell, Error};
+use ckb_types::packed::CellInput;
+
+fn dao_header(header: &HeaderView) -> DaoHeader {
+    let mut dao = [0u8; 32];
+    dao.copy_from_slice(header.dao().as_slice());
+    DaoHeader::from_dao(header.number(), &dao)
+}
+
+#[test]
+fn test_select_fewest_heights() {
+    let target = DaoHeader {
+        block_number: 3000,
+        accumulate_rate: 10003000,
+    };
+    let headers = vec![
+        DaoHeader {
+            block_number: 1000,
+            accumulate_rate: 10001000,
+        },
+        DaoHeader {
+            block_number: 2000,
+            accumulate_rate: 10002000,
+        },
+    ];
+    let cell = |amount, deposit_block_number| DckbCell {
+        amount,
+        deposit_block_number,
+    };
+    let cells = vec![
+        cell(100, 1000),
+        cell(100, 2000),
+        cell(300, 2000),
+        cell(50, 3000),
+        // deposited after the target
+        cell(1000, 4000),
+        cell(150, 2000),
+    ];
+
+    // height 2000 alone covers 500
+    let selection = selector::select(&cells, &headers, &target, 500).expect("select");
+    assert_eq!(selection.inputs, vec![1, 2, 5]);
+    assert_eq!(selection.header_deps, vec![3000, 2000]);
+    assert_eq!(selection.header_hints, vec![1, 1, 1]);
+    let aligned: u64 = selection
+        .inputs
+        .iter()
+        .map(|&i| selector::align_amount(cells[i].amount, &headers[1], &target).unwrap())
+        .sum();
+    assert_eq!(selection.aligned_amount, aligned);
+
+    // the largest cells cover 300 without height 1000
+    let selection = selector::select(&cells, &headers, &target, 300).expect("select");
+    assert_eq!(selection.inputs, vec![2]);
+
+    // all usable cells
+    let selection = selector::select(&cells, &headers, &target, 700).expect("select");
+    assert_eq!(selection.header_deps, vec![3000, 2000, 1000]);
+    assert_eq!(selection.inputs, vec![3, 1, 2, 5, 0]);
+    assert_eq!(selection.header_hints, vec![0, 1, 1, 1, 2]);
+
+    assert_eq!(
+        selector::select(&cells, &headers, &target, 800),
+        Err(Error::NotEnough { available: 700 })
+    );
+    assert_eq!(
+        selector::select(&cells, &headers[1..], &target, 100),
+        Err(Error::UnknownHeader(1000))
+    );
+}
+
+// a transfer of the selected inputs to one DCKB output
+fn selected_transfer_tx(
+    coins: &[(u64, usize)],
+    amount: u64,
+) -> (ResolvedTransaction, DummyDataLoader) {
+    let mut data_loader = DummyDataLoader::new();
+    let (privkey, lock_args) = gen_lock();
+    let headers: Vec<HeaderView> = vec![
+        gen_header(1554, 10000000, 35, 1000, 1000),
+        gen_header(1000001, 10000777, 400, 1000000, 1000),
+        gen_header(2000610, 10001000, 575, 2000000, 1100),
+    ]
+    .into_iter()
+    .map(|(header, epoch)| {
+        data_loader.headers.insert(header.hash(), header.clone());
+        data_loader.epoches.insert(header.hash(), epoch);
+        header
+    })
+    .collect();
+    let target = dao_header(&headers[2]);
+    let dao_headers: Vec<DaoHeader> = headers.iter().map(dao_header).collect();
+
+    let wallet: Vec<DckbCell> = coins
+        .iter()
+        .map(|&(amount, height)| DckbCell {
+            amount,
+            deposit_block_number: headers[height].number(),
+        })
+        .collect();
+    let cells: Vec<_> = wallet
+        .iter()
+        .map(|cell| {
+            gen_dckb_cell(
+                &mut data_loader,
+                cell.amount,
+                cell.deposit_block_number,
+                lock_args.clone(),
+            )
+        })
+        .collect();
+    let selection = selector::select(&wallet, &dao_headers, &target, amount).expect("select");
+
+    let dckb_witness = WitnessArgs::new_builder()
+        .type_(Bytes::from(selection.input_type()).pack())
+        .build();
+    let mut builder = TransactionBuilder::default()
+        .output(dckb_cell_output())
+        .output_data(dckb_data(selection.aligned_amount.into(), target.block_number).pack())
+        .witness(dckb_witness.as_bytes().pack());
+    let mut resolved_inputs = Vec::new();
+    for &i in selection.inputs.iter() {
+        let (ref cell, ref out_point, ref data) = cells[i];
+        builder = builder.input(CellInput::new(out_point.clone(), 0));
+        resolved_inputs.push(
+            CellMetaBuilder::from_cell_output(cell.clone(), data.clone())
+                .out_point(out_point.clone())
+                .build(),
+        );
+    }
+    for &number in selection.header_deps.iter() {
+        let header = headers.iter().find(|h| h.number() == number).unwrap();
+        builder = builder.header_dep(header.hash());
+    }
+    let (tx, resolved_cell_deps) = complete_tx(&mut data_loader, builder);
+    let tx = sign_tx(tx, &privkey);
+    let rtx = ResolvedTransaction {
+        transaction: tx,
+        resolved_inputs,
+        resolved_cell_deps,
+        resolved_dep_groups: vec![],
+    };
+    (rtx, data_loader)
+}
+
+#[test]
+fn test_select_verify() {
+    let coins = vec![
+        (100_00000000, 0),
+        (2000_00000000, 1),
+        (50_00000000, 0),
+        (3000_00000000, 1),
+        (700_00000000, 2),
+    ];
+    for amount in &[1, 3000_00000000, 5000_00000000, 5800_00000000] {
+        let (rtx, data_loader) = selected_transfer_tx(&coins, *amount);
+        let verify_result = verify_tx(&rtx, &data_loader);
+        verify_result.expect("pass verification");
+    }
+}